@@ -0,0 +1,186 @@
+
+// *** MSD averaged over all time origins ***
+
+// The MSD of the time series is measured from the start of the run only, so at long lags it is a
+// single sample. Instead this keeps the unwrapped position of every cell relative to the center
+// of mass, by the index of the cell, every stride steps. At the end the MSD at lag m is averaged
+// over all pairs of samples m apart:
+//
+//     MSD(m) = 1/(T-m) sum_t |r(t+m) - r(t)|^2 = S1(m) - 2 S2(m)
+//
+// S1(m), the mean of |r(t)|^2 + |r(t+m)|^2, follows from the sums of |r|^2 over the cells one lag
+// after the other. S2(m), the mean of r(t).r(t+m), is an autocorrelation, which the FFT gives from
+// the power spectrum of the series padded with zeros to twice its length (Wiener-Khinchin). The
+// power spectra are summed over the cells, so one inverse transform gives S2 for all of them.
+// Two coordinates are packed into one complex transform: the power spectrum of x + iy, averaged
+// with its mirror image at -k, is the sum of those of x and y.
+//
+// The buffer holds at most `capacity` samples. When it is full every other sample is dropped and
+// the stride doubles, so the whole run is kept at a resolution that gets coarser as it goes on.
+
+template <int D>
+struct AveragedMSD
+{
+    AveragedMSD();
+
+    void setup(long int, int, long int);
+    void add(long int, Cells<D>&, std::array<double, D>&);
+    void results(vector<long int>&, vector<double>&, int);
+    void save(Checkpoint&);
+    void load(Checkpoint&);
+
+    bool active;
+    long int N;
+    int capacity;                       // Samples kept of every coordinate
+    long int stride;                    // Steps between samples
+    long int first;                     // Step of the first sample
+    int samples;                        // Samples taken so far
+
+private:
+    vector<double> positions;           // Coordinate k of cell n at sample s at (n*D+k)*capacity+s
+};
+
+template <int D>
+AveragedMSD<D>::AveragedMSD()
+{
+    active = false;
+    N = 0;
+    capacity = 0;
+    stride = 1;
+    first = -1;
+    samples = 0;
+}
+
+template <int D>
+void AveragedMSD<D>::setup(long int N_, int capacity_, long int stride_)
+// capacity is even. stride is the interval of the calls to add.
+{
+    N = N_;
+    capacity = capacity_;
+    stride = stride_;
+    first = -1;
+    samples = 0;
+    positions.assign(N*D*capacity, 0.0);
+    active = true;
+}
+
+template <int D>
+void AveragedMSD<D>::add(long int t, Cells<D> &cell, std::array<double, D> &COM)
+// The positions at step t, if it is one of the samples. All cells must be in this process.
+{
+    if(first < 0) first = t;
+    if((t-first)%stride != 0) return;
+
+    if(samples == capacity)
+    {
+        for(long int c=0; c<N*D; c++)
+        {
+            double *series = positions.data() + c*capacity;
+            for(int s=0; s<capacity/2; s++) series[s] = series[2*s];
+        }
+        samples = capacity/2;
+        stride *= 2;
+        if((t-first)%stride != 0) return;
+    }
+
+    for(int i=0; i<cell.N; i++)
+    {
+        for(int k=0; k<D; k++)
+            positions[((long int)cell.index[i]*D+k)*capacity+samples] = cell.x_real[k][i] - COM[k];
+    }
+    samples++;
+}
+
+template <int D>
+void AveragedMSD<D>::results(vector<long int> &lag, vector<double> &msd, int threads)
+// The MSD per cell at every lag, in steps, that the samples have
+{
+    lag.clear();
+    msd.clear();
+    int T = samples;
+    if(T < 2) return;
+
+    int M = 1;
+    while(M < 2*T) M *= 2;
+
+    vector<double> power(M, 0.0);       // Power spectrum, summed over the coordinates of all cells
+    vector<double> square(T, 0.0);      // |r(t)|^2, summed over all cells
+
+    #pragma omp parallel num_threads(threads)
+    {
+        FFT fft(M, 1);
+        vector<complex<double>> z(M);
+        vector<double> myPower(M, 0.0);
+        vector<double> mySquare(T, 0.0);
+
+        #pragma omp for schedule(dynamic, 64)
+        for(long int n=0; n<N; n++)
+        {
+            for(int k=0; k<D; k+=2)
+            {
+                const double *a = positions.data() + (n*D+k)*capacity;
+                const double *b = (k+1 < D) ? positions.data() + (n*D+k+1)*capacity : nullptr;
+
+                for(int s=0; s<T; s++)
+                {
+                    double bs = b ? b[s] : 0.0;
+                    z[s] = complex<double>(a[s], bs);
+                    mySquare[s] += a[s]*a[s] + bs*bs;
+                }
+                for(int s=T; s<M; s++) z[s] = 0.0;
+
+                fft.transform(z, false);
+                for(int q=0; q<M; q++) myPower[q] += 0.5*(std::norm(z[q]) + std::norm(z[(M-q)%M]));
+            }
+        }
+
+        #pragma omp critical
+        {
+            for(int q=0; q<M; q++) power[q] += myPower[q];
+            for(int s=0; s<T; s++) square[s] += mySquare[s];
+        }
+    }
+
+    // The power spectrum is real and even, so its inverse transform is the real autocorrelation
+
+    vector<complex<double>> product(M);
+    for(int q=0; q<M; q++) product[q] = power[q];
+    FFT(M, 1).transform(product, true);
+
+    double ends = 0.0;
+    for(int s=0; s<T; s++) ends += 2.0*square[s];
+
+    for(int m=0; m<T; m++)
+    {
+        if(m > 0) ends -= square[m-1] + square[T-m];
+        double S1 = ends/(T-m);
+        double S2 = product[m].real()/M/(T-m);
+
+        lag.push_back(m*stride);
+        msd.push_back((S1 - 2.0*S2)/N);
+    }
+}
+
+template <int D>
+void AveragedMSD<D>::save(Checkpoint &file)
+{
+    file.put(active);
+    file.put(N);
+    file.put(capacity);
+    file.put(stride);
+    file.put(first);
+    file.put(samples);
+    file.put(positions);
+}
+
+template <int D>
+void AveragedMSD<D>::load(Checkpoint &file)
+{
+    file.get(active);
+    file.get(N);
+    file.get(capacity);
+    file.get(stride);
+    file.get(first);
+    file.get(samples);
+    file.get(positions);
+}
@@ -1,28 +1,56 @@
-
 // *** One spatial partition of the simulation area ***
 
+template <int D>
 struct Box
 {
     Box();
     
+    static const int nnb = (D==2) ? 9 : 27;   // Neighboring boxes, including itself
+    
     int serial_index;
-    vector<int> vector_index;
-    vector<double> min, max;
-    vector<double> center;
-    vector<int> neighbors;
-    vector<int> CellList;
+    std::array<int, D> vector_index;
+    std::array<double, D> min, max;
+    std::array<double, D> center;
+    std::array<int, nnb> neighbors;
 };
 
-Box::Box(){
+template <int D>
+Box<D>::Box(){
     serial_index = -1;
-    vector_index.assign(NDIM,-1);
-    min.assign(NDIM,0);
-    max.assign(NDIM,0);
-    center.assign(NDIM,0);
-    
-    if(NDIM==2) neighbors.assign(9,0);
-    if(NDIM==3) neighbors.assign(27,0);
+    vector_index.fill(-1);
+    min.fill(0);
+    max.fill(0);
+    center.fill(0);
+    neighbors.fill(0);
+}
+
+// *** Cells sorted by box ***
+
+// The cells of box p are index[start[p]] ... index[start[p+1]-1], in increasing cell order.
+// Both arrays are filled by a counting sort on the box number of every cell.
+
+struct CellList
+{
+    void sort(ivec&, int);
+    int size(int p) { return start[p+1] - start[p]; }
+    int* cells(int p) { return index.data() + start[p]; }      // Also valid for an empty last box
+
+    vector<int> start;
+    vector<int> index;
+    vector<int> next;               // Scratch space for the fill pass
+};
+
+void CellList::sort(ivec &box, int nbox)
+{
+    int N = box.size();
+
+    start.assign(nbox+1,0);
+    index.resize(N);
+
+    for (int i=0; i<N; i++) start[box[i]+1]++;
+    for (int p=0; p<nbox; p++) start[p+1] += start[p];
 
-    CellList.reserve(50);
+    next.assign(start.begin(), start.end()-1);
+    for (int i=0; i<N; i++) index[next[box[i]]++] = i;
 }
 
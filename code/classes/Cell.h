@@ -1,181 +1,310 @@
-//#include <iostream>
-//using std::cout;
-//using std::endl;
-//using std::cin;
 
-struct Cell
+// *** Structure-of-arrays storage for all cells ***
+
+// Every per-cell quantity lives in its own contiguous array, aligned to a cache line, so
+// the force and integration loops stream through memory instead of following one heap
+// pointer per coordinate per cell. Cell i is the i-th entry of every array.
+
+#include <array>
+#include <cstdlib>
+#include <new>
+
+template <typename T>
+struct AlignedAllocator
 {
-    Cell();
-    
-    void update(double&);
-    void PBC();
-    void periodicAngles();
-    double get_speed();
-    
+    typedef T value_type;
+    static const size_t alignment = 64;
+
+    AlignedAllocator() {}
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        void *p = 0;
+        if( posix_memalign(&p, alignment, n*sizeof(T)) != 0 ) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T *p, size_t) { free(p); }
+
+    template <typename U> struct rebind { typedef AlignedAllocator<U> other; };
+};
+
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return false; }
+
+typedef vector<double, AlignedAllocator<double> > dvec;
+typedef vector<int, AlignedAllocator<int> > ivec;
+
+template <int D>
+struct Cells
+{
+    Cells();
+
+    void resize(int, double);
+    void resizeArrays(int);
+    void permute(vector<int>&);
+    void update(double&, std::array<double, D>&, std::array<double, D>&, double&, double&);
+    double get_speed(int);
+    void save(Checkpoint&);
+    void load(Checkpoint&);
+
+    int N;                          // Number of cells owned by this process
+    int nGhost;                     // Copies of other processes' cells, stored after the own cells
     double L, Lover2, dt;
-    
-    double R;                       // Cell radius
-    double Rinv; 					// 1/R
+
     const double Zinv = (9*PI)/16;  // Proportionality constant for Stoke's law in 3D
-    
-    int over;    					// Overlap that cell has with neighbours: 240(blue, no overlap) to 0(red, big overlap) [Hue]
-    int index;                      // Cell number
-    int box;                        // Box number to which the cell belongs
-    
-    vector<double> x;            	// Position in the grid
-    vector<double> x_real;        	// Real position if it weren't for periodic boundary conditions
-    vector<double> x0;            	// Initial positions
-    vector<double> x_old;         	// Old position to determine displacement during a skin interval
-	
-    double vx;						// Velocity
-    double vy;
-    double vz;
-	
-    double Fx;               		// Force
-    double Fy;
-    double Fz;
-    
-    double phi, theta;              // Self-propulsion vector in x-y plane, angle from z-axis
-    double cosp, sinp,
-           cost, sint;
-    double x_new, y_new, z_new;     // Projections of the cell's self-propulsion vector
-    
-    vector<int> VerletList;
+
+    dvec R;                         // Cell radius
+    dvec Rinv;                      // 1/R
+
+    ivec over;                      // Overlap that cell has with neighbours: 240(blue, no overlap) to 0(red, big overlap) [Hue]
+    ivec index;                     // Cell number, follows the cell when the arrays are reordered
+    ivec box;                       // Box number to which the cell belongs
+
+    std::array<dvec, D> x;          // Position in the grid
+    std::array<dvec, D> x_real;     // Real position if it weren't for periodic boundary conditions
+    std::array<dvec, D> x0;         // Initial positions
+    std::array<dvec, D> x_old;      // Old position to determine displacement during a skin interval
+
+    std::array<dvec, D> v;          // Velocity
+    std::array<dvec, D> F;          // Force
+
+    std::array<dvec, D> u;          // Self-propulsion direction, a unit vector
+    std::array<dvec, D> u_new;      // Sum of the directions in the cell's neighborhood, itself included
+
+    ivec verletStart;               // Verlet list of cell i is verletList[verletStart[i]] ... verletList[verletStart[i+1]-1]
+    ivec verletList;                // Every pair of cells within the skin radius is listed once
 };
 
-Cell::Cell()
+template <int D>
+Cells<D>::Cells()
 {
+    N = 0;
+    nGhost = 0;
     L = -1.0;
     Lover2 = -1.0;
     dt = -1.0;
-    R = -1.0;
-	
-    Fx = 0.0;
-    Fy = 0.0;
-    Fz = 0.0;
-    vx = 0.0;
-    vy = 0.0;
-    vz = 0.0;
-    
-    box = -1;
-    index = -1;
-    over = 0;
+}
+
+template <int D>
+void Cells<D>::resize(int n, double dt_)
+// Allocate every array for n cells.
+{
+    N = n;
+    nGhost = 0;
+    dt = dt_;
+
+    R.assign(N,-1.0);
+    Rinv.assign(N,-1.0);
+
+    over.assign(N,0);
+    box.assign(N,-1);
+    index.resize(N);
+    for(int i=0; i<N; i++) index[i] = i;
+
+    for(int k=0; k<D; k++)
+    {
+        x[k].assign(N,-100);
+        x_real[k].assign(N,-100);
+        x0[k].assign(N,-100);
+        x_old[k].assign(N,-100);
+        v[k].assign(N,0.0);
+        F[k].assign(N,0.0);
+        u[k].assign(N,0.0);
+        u_new[k].assign(N,0.0);
+    }
+
+    verletStart.assign(N+1,0);
+    verletList.clear();
+}
+
+template <int D>
+void Cells<D>::resizeArrays(int n)
+// Make room for n cells in every per-cell array, keeping the cells already stored. N is unchanged.
+{
+    R.resize(n);
+    Rinv.resize(n);
+    over.resize(n);
+    box.resize(n);
+    index.resize(n);
+
+    for(int k=0; k<D; k++)
+    {
+        x[k].resize(n);
+        x_real[k].resize(n);
+        x0[k].resize(n);
+        x_old[k].resize(n);
+        v[k].resize(n);
+        F[k].resize(n);
+        u[k].resize(n);
+        u_new[k].resize(n);
+    }
+}
+
+template <typename T>
+void permuteArray(T &a, vector<int> &order, T &temp)
+// a[n] <- a[order[n]]
+{
+    int n = order.size();
+    temp.resize(n);
+    for(int m=0; m<n; m++) temp[m] = a[order[m]];
+    a.swap(temp);
+}
+
+template <int D>
+void Cells<D>::permute(vector<int> &order)
+// Reorder the cells so that the cell at position order[n] moves to position n. Cells that are
+// not in order are dropped, and N becomes the length of order. Verlet lists are carried along
+// and their entries relabelled; they must not refer to dropped cells.
+{
+    dvec dtemp;
+    ivec itemp;
     
-    x.assign(NDIM,-100);
-    x_old.assign(NDIM,-100);
-    x0.assign(NDIM,-100);
-    x_real.assign(NDIM,-100);
+    int n = order.size();
+    vector<int> position(R.size());
+    for(int m=0; m<n; m++) position[order[m]] = m;
     
-    phi = theta = 0.0;
-    cosp = sinp = cost = sint = 0.0;
-    x_new = y_new = z_new = 0.0;
+    permuteArray(R, order, dtemp);
+    permuteArray(Rinv, order, dtemp);
+    permuteArray(over, order, itemp);
+    permuteArray(index, order, itemp);
+    permuteArray(box, order, itemp);
     
-    if(NDIM==2){
-        theta = PI/2.0;
-        cost = 0.0;
-        sint = 1.0;
-        VerletList.reserve(20);
+    for(int k=0; k<D; k++)
+    {
+        permuteArray(x[k], order, dtemp);
+        permuteArray(x_real[k], order, dtemp);
+        permuteArray(x0[k], order, dtemp);
+        permuteArray(x_old[k], order, dtemp);
+        permuteArray(v[k], order, dtemp);
+        permuteArray(F[k], order, dtemp);
+        permuteArray(u[k], order, dtemp);
+        permuteArray(u_new[k], order, dtemp);
     }
     
-    if(NDIM==3)
+    ivec start(n+1), list(verletList.size());
+    start[0] = 0;
+    for(int m=0; m<n; m++)
     {
-        VerletList.reserve(40);
+        int i = order[m];
+        int size = verletStart[i+1] - verletStart[i];
+        for(int k=0; k<size; k++) list[start[m]+k] = position[verletList[verletStart[i]+k]];
+        start[m+1] = start[m] + size;
     }
-};
+    list.resize(start[n]);
+    verletStart.swap(start);
+    verletList.swap(list);
+    
+    N = n;
+    nGhost = 0;
+}
 
-void Cell::update(double &CFself)
-// Update particle positions and orientations from the equations of motion:
+template <int D>
+void Cells<D>::update(double &CFself, std::array<double, D> &shift, std::array<double, D> &sum,
+                      double &largest2, double &second2)
+// Update particle positions from the equations of motion:
 // F_i = 6*pi*eta*R_i in 2D
 // F_i = (32/3)*eta*R_i in 3D
 // Let eta = 1/(6pi) in 2D, then in 3D the proportionality constant is 16/(9*pi)
+//
+// The same sweep adds up the real positions for the center of mass in sum, and finds the two
+// largest squared displacements from x_old, less shift, for the next Verlet list check.
 {
-    if(NDIM==2)
-    {
-        periodicAngles();
-        
-        cosp = cos(phi);
-        sinp = sin(phi);
-        
-        Fx += cosp*CFself*R;         // Self-propulsion force
-        Fy += sinp*CFself*R;
-        
-        x_new = cosp;                // The average direction of particles in the neighborhood
-        y_new = sinp;                // also includes itself
-		
-        vx = Fx*Rinv;
-        vy = Fy*Rinv;
-		
-        double dx = vx*dt;
-        double dy = vy*dt;
-		
-		x[0] += dx;
-		x[1] += dy;
-		x_real[0] += dx;
-		x_real[1] += dy;
-		
-		Fx = 0.0;
-		Fy = 0.0;
-    }
-    
-    if(NDIM==3)
+    double mobility = 1.0;
+    if constexpr (D==3) mobility = Zinv;
+
+    sum.fill(0.0);
+    largest2 = second2 = 0.0;
+
+    for(int i=0; i<N; i++)
     {
-        periodicAngles();
-        
-        cosp = cos(phi);
-        sinp = sin(phi);
-        cost = cos(theta);
-        sint = sin(theta);
-        
-        Fx += sint*cosp*CFself*R;
-        Fy += sint*sinp*CFself*R;
-        Fz += cost*CFself*R;
-        
-        x_new = cosp*sint;
-        y_new = sinp*sint;
-        z_new = cost;
-		
-        vx = Fx*Zinv*Rinv;
-        vy = Fy*Zinv*Rinv;
-        vz = Fz*Zinv*Rinv;
-		
-        double dx = vx*dt;
-        double dy = vy*dt;
-        double dz = vz*dt;
-		
-		x[0] += dx;
-		x[1] += dy;
-		x[2] += dz;
-		x_real[0] += dx;
-		x_real[1] += dy;
-		x_real[2] += dz;
-		
-		Fx = 0.0;
-		Fy = 0.0;
-		Fz = 0.0;
+        double d2 = 0.0;
+        for(int k=0; k<D; k++)
+        {
+            F[k][i] += u[k][i]*CFself*R[i];       // Self-propulsion force
+            u_new[k][i] = u[k][i];                // The average direction of particles in the neighborhood
+                                                  // also includes itself
+            v[k][i] = F[k][i]*mobility*Rinv[i];
+
+            double dx = v[k][i]*dt;
+            double xk = x[k][i] + dx;
+            if(xk >= Lover2)      xk -= L;
+            else if(xk < -Lover2) xk += L;
+            x[k][i] = xk;
+            x_real[k][i] += dx;
+            F[k][i] = 0.0;
+
+            sum[k] += x_real[k][i];
+
+            double dk = xk - x_old[k][i] - shift[k];
+            if(dk >= Lover2)      dk -= L;
+            else if(dk < -Lover2) dk += L;
+            d2 += dk*dk;
+        }
+
+        if(d2 > largest2)     { second2 = largest2; largest2 = d2; }
+        else if(d2 > second2) { second2 = d2; }
     }
-    
-    PBC();
 }
 
-void Cell::periodicAngles()
+template <int D>
+double Cells<D>::get_speed(int i)
 {
-    if(phi >= PI)           phi  -= PI2;
-    else if(phi < -PI)      phi  += PI2;
-    if(theta >= PI)         theta = PI2-theta;
-    else if(theta < 0)      theta = -theta;
+    double v2 = 0.0;
+    for(int k=0; k<D; k++) v2 += v[k][i]*v[k][i];
+    return sqrt(v2);
 }
 
-void Cell::PBC()
+template <int D>
+void Cells<D>::save(Checkpoint &file)
+// Every array, ghosts included, and the Verlet lists. The sizes come from resize.
 {
-    for(int k=0; k<NDIM; k++)
+    file.put(N);
+    file.put(nGhost);
+    file.put(R);
+    file.put(Rinv);
+    file.put(over);
+    file.put(index);
+    file.put(box);
+    for(int k=0; k<D; k++)
     {
-        if(x[k] >= Lover2)      x[k] -= L;
-        else if(x[k] < -Lover2) x[k] += L;
+        file.put(x[k]);
+        file.put(x_real[k]);
+        file.put(x0[k]);
+        file.put(x_old[k]);
+        file.put(v[k]);
+        file.put(F[k]);
+        file.put(u[k]);
+        file.put(u_new[k]);
     }
+    file.put(verletStart);
+    file.put(verletList);
 }
 
-double Cell::get_speed()
+template <int D>
+void Cells<D>::load(Checkpoint &file)
 {
-    if(NDIM==2) 		return sqrt(vx*vx+vy*vy);
-    else if(NDIM==3) 	return sqrt(vx*vx+vy*vy+vz*vz);
+    file.get(N);
+    file.get(nGhost);
+    file.get(R);
+    file.get(Rinv);
+    file.get(over);
+    file.get(index);
+    file.get(box);
+    for(int k=0; k<D; k++)
+    {
+        file.get(x[k]);
+        file.get(x_real[k]);
+        file.get(x0[k]);
+        file.get(x_old[k]);
+        file.get(v[k]);
+        file.get(F[k]);
+        file.get(u[k]);
+        file.get(u_new[k]);
+    }
+    file.get(verletStart);
+    file.get(verletList);
 }
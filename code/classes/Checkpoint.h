@@ -0,0 +1,106 @@
+
+// *** Binary checkpoint files ***
+
+// A checkpoint holds the complete state of a run between two time steps, so that a run that was
+// stopped can go on as if it never had been. Values are written as raw bytes, in the byte order
+// of the machine, so a checkpoint is meant to be read back on the same machine type by the same
+// build. Vectors are stored as their length followed by their elements.
+//
+// A new checkpoint is written next to the old one and only then renamed over it, so a job that
+// is killed while writing still leaves the previous checkpoint intact. The temporary file is
+// named after the process, so jobs that write the same file at once do not mix their bytes.
+
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <unistd.h>
+
+struct Checkpoint
+{
+    Checkpoint();
+    ~Checkpoint();
+
+    void create(string);
+    void open(string);
+    void commit();
+
+    template <typename T> void put(const T&);
+    template <typename T, typename A> void put(const vector<T, A>&);
+    template <typename T> void get(T&);
+    template <typename T, typename A> void get(vector<T, A>&);
+
+    string file;
+
+private:
+    fstream stream;
+    void fail(string, int);
+};
+
+Checkpoint::Checkpoint()
+{
+}
+
+Checkpoint::~Checkpoint()
+{
+    if(stream.is_open()) stream.close();
+}
+
+void Checkpoint::fail(string what, int status)
+{
+    cout << what << " " << file << ". Status " << status << "\n";
+    exit(status);
+}
+
+void Checkpoint::create(string name)
+// Start writing a new checkpoint. It replaces name only when commit is called.
+{
+    file = name;
+    stream.open((file+".tmp"+to_string(getpid())).c_str(), ios::out | ios::binary | ios::trunc);
+    if(!stream) fail("Cannot write checkpoint", 730);
+}
+
+void Checkpoint::open(string name)
+{
+    file = name;
+    stream.open(file.c_str(), ios::in | ios::binary);
+    if(!stream) fail("Cannot read checkpoint", 731);
+}
+
+void Checkpoint::commit()
+// Finish writing and put the new checkpoint in place of the old one.
+{
+    stream.close();
+    if(stream.fail()) fail("Cannot write checkpoint", 730);
+    if(rename((file+".tmp"+to_string(getpid())).c_str(), file.c_str()) != 0) fail("Cannot write checkpoint", 730);
+}
+
+template <typename T>
+void Checkpoint::put(const T &value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T, typename A>
+void Checkpoint::put(const vector<T, A> &values)
+{
+    uint64_t n = values.size();
+    put(n);
+    stream.write(reinterpret_cast<const char*>(values.data()), n*sizeof(T));
+}
+
+template <typename T>
+void Checkpoint::get(T &value)
+{
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if(!stream) fail("Checkpoint ends early", 732);
+}
+
+template <typename T, typename A>
+void Checkpoint::get(vector<T, A> &values)
+{
+    uint64_t n = 0;
+    get(n);
+    values.resize(n);
+    stream.read(reinterpret_cast<char*>(values.data()), n*sizeof(T));
+    if(!stream) fail("Checkpoint ends early", 732);
+}
@@ -0,0 +1,363 @@
+
+// ********************************************************************************
+// **** Cluster-pair kernel for the force and alignment loop                    ***
+// ********************************************************************************
+
+// *** Templated on the number of dimensions D ***
+
+// The cells of every box are grouped into clusters of W cells, the last cluster of a box padded
+// with empty slots. At each list refresh we record, for every cluster, the clusters it can
+// interact with before the next refresh. The force loop then works on W cells at a time:
+// one cell of the first cluster against all W cells of the second, with masks instead of
+// branches for the interaction and overlap cut-offs.
+//
+// Positions, radii and orientations are copied into cluster order once per step, so that the
+// W cells of a cluster are contiguous in memory. Empty slots sit far outside the simulation
+// area and far from each other, so they fail every distance comparison.
+//
+// Build with -march=native, or at least -mavx2. Without AVX the fixed-size vectors fall back to
+// scalar code and this kernel is about half as fast as the pair loop, so runs refuse it then.
+
+#include <experimental/simd>
+
+namespace stdx = std::experimental;
+
+#ifdef __AVX__
+const bool clusterVectorised = true;
+#else
+const bool clusterVectorised = false;
+#endif
+
+template <int D>
+struct Clusters
+{
+    static const int W = 4;                             // Cells per cluster
+    typedef stdx::fixed_size_simd<double, W> vdouble;
+    typedef stdx::fixed_size_simd_mask<double, W> vmask;
+
+    Clusters();
+
+    void build(Cells<D>&, const vector<Box<D>>&, CellList&, double);
+    void gather(Cells<D>&);
+    void interactions(int, double, double, bool);
+    void scatter(Cells<D>&, bool);
+    void save(Checkpoint&);
+    void load(Checkpoint&);
+
+    int nclusters;
+    vector<int> boxStart;           // Clusters of box p are boxStart[p] ... boxStart[p+1]-1
+    vector<int> pairStart;          // Partner clusters of cluster c are pairs[pairStart[c]] ... pairs[pairStart[c+1]-1]
+    vector<int> pairs;              // Only partners with a number >= c, including c itself
+    ivec member;                    // Cell in each slot, -1 for an empty slot
+
+    std::array<dvec, D> x;          // Position, cluster order
+    std::array<dvec, D> u;          // Self-propulsion direction
+    std::array<dvec, D> F;          // Force
+    std::array<dvec, D> u_sum;      // Sum of neighbors' directions
+    dvec R;                         // Radius, 0 for an empty slot
+    dvec over;                      // Overlap for the video
+};
+
+template <int D>
+Clusters<D>::Clusters()
+{
+    nclusters = 0;
+}
+
+template <int D>
+void Clusters<D>::build(Cells<D> &cell, const vector<Box<D>> &grid, CellList &boxCells, double rs2)
+// Group the cells of each box into clusters and list the cluster pairs that have at least one
+// pair of cells within the skin radius. Must follow assignCellsToGrid.
+{
+    int nbox = grid.size();
+
+    boxStart.resize(nbox+1);
+    nclusters = 0;
+    for(int p=0; p<nbox; p++)
+    {
+        boxStart[p] = nclusters;
+        nclusters += (boxCells.size(p) + W-1)/W;
+    }
+    boxStart[nbox] = nclusters;
+
+    int nslots = nclusters*W;
+    member.assign(nslots, -1);
+    R.assign(nslots, 0.0);
+    over.assign(nslots, 0.0);
+    for(int k=0; k<D; k++)
+    {
+        x[k].resize(nslots);
+        for(int s=0; s<nslots; s++) x[k][s] = 1e6 + 1e3*s;
+        u[k].assign(nslots, 0.0);
+        F[k].assign(nslots, 0.0);
+        u_sum[k].assign(nslots, 0.0);
+    }
+
+    // Clusters should be compact, so the cells of a box are sorted along a Morton curve over
+    // a finer grid of 8 sub-boxes per axis before they are cut into groups of W.
+
+    double sub = 8.0/(grid[0].max[0] - grid[0].min[0]);
+    vector<pair<unsigned int, int>> sorted;
+
+    for(int p=0; p<nbox; p++)
+    {
+        int max = boxCells.size(p);
+        int *inBox = boxCells.cells(p);
+
+        sorted.resize(max);
+        for(int n=0; n<max; n++)
+        {
+            int i = inBox[n];
+            unsigned int code = 0;
+            for(int k=0; k<D; k++)
+            {
+                int c = (int)((cell.x[k][i] - grid[p].min[k])*sub);
+                c = std::min(std::max(c, 0), 7);
+                for(int bit=0; bit<3; bit++) code |= ((c >> bit) & 1) << (D*bit + k);
+            }
+            sorted[n] = make_pair(code, i);
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        for(int n=0; n<max; n++)
+        {
+            int s = boxStart[p]*W + n;
+            member[s] = sorted[n].second;
+            R[s] = cell.R[sorted[n].second];
+        }
+    }
+
+    gather(cell);
+
+    double L = cell.L;
+    double Lover2 = cell.Lover2;
+
+    pairStart.resize(nclusters+1);
+    pairs.clear();
+
+    for(int p=0; p<nbox; p++)
+    {
+        // With fewer than three boxes along an axis, a box appears more than once among its neighbors.
+
+        std::array<int, Box<D>::nnb> nb = grid[p].neighbors;
+        std::sort(nb.begin(), nb.end());
+        int nnb = std::unique(nb.begin(), nb.end()) - nb.begin();
+
+        for(int ci=boxStart[p]; ci<boxStart[p+1]; ci++)
+        {
+            pairStart[ci] = pairs.size();
+
+            for(int m=0; m<nnb; m++)
+            {
+                for(int cj=boxStart[nb[m]]; cj<boxStart[nb[m]+1]; cj++)
+                {
+                    if(cj < ci) continue;
+                    if(cj == ci){ pairs.push_back(cj); continue; }
+
+                    vdouble xj[D];
+                    for(int k=0; k<D; k++) xj[k].copy_from(&x[k][cj*W], stdx::element_aligned);
+
+                    bool close = false;
+                    for(int l=0; l<W && !close; l++)
+                    {
+                        vdouble d2 = 0.0;
+                        for(int k=0; k<D; k++)
+                        {
+                            vdouble dx = xj[k] - x[k][ci*W+l];
+                            where(dx >= Lover2, dx) -= L;
+                            where(dx < -Lover2, dx) += L;
+                            d2 += dx*dx;
+                        }
+                        close = any_of(d2 < rs2);
+                    }
+                    if(close) pairs.push_back(cj);
+                }
+            }
+        }
+    }
+    pairStart[nclusters] = pairs.size();
+}
+
+template <int D>
+void Clusters<D>::gather(Cells<D> &cell)
+// Copy positions and directions into cluster order, clear the sums.
+{
+    int nslots = nclusters*W;
+    for(int s=0; s<nslots; s++)
+    {
+        int i = member[s];
+        if(i < 0) continue;
+
+        for(int k=0; k<D; k++)
+        {
+            x[k][s] = cell.x[k][i];
+            u[k][s] = cell.u[k][i];
+            F[k][s] = 0.0;
+            u_sum[k][s] = 0.0;
+        }
+        over[s] = 0.0;
+    }
+}
+
+template <int D>
+void Clusters<D>::interactions(int ci, double L, double rn2, bool film)
+// Spring repulsion and neighbor directions between cluster ci and all its partners. The sums
+// for the cells of ci are kept in vectors and only added up across lanes at the end.
+{
+    double Lover2 = L/2.0;
+    vdouble lane([](int m){ return (double)m; });
+
+    vdouble Fi[W][D], ui_sum[W][D], overi[W];
+    for(int l=0; l<W; l++)
+    {
+        for(int k=0; k<D; k++)
+        {
+            Fi[l][k] = 0.0;
+            ui_sum[l][k] = 0.0;
+        }
+        overi[l] = 0.0;
+    }
+
+    for(int q=pairStart[ci]; q<pairStart[ci+1]; q++)
+    {
+        int cj = pairs[q];
+        int sj = cj*W;
+
+        vdouble xj[D], uj[D], Fj[D], uj_sum[D];
+        for(int k=0; k<D; k++)
+        {
+            xj[k].copy_from(&x[k][sj], stdx::element_aligned);
+            uj[k].copy_from(&u[k][sj], stdx::element_aligned);
+            Fj[k] = 0.0;
+            uj_sum[k] = 0.0;
+        }
+        vdouble Rj(&R[sj], stdx::element_aligned);
+        vdouble overj = 0.0;
+
+        for(int l=0; l<W; l++)
+        {
+            int si = ci*W + l;
+
+            vdouble dx[D];
+            vdouble d2 = 0.0;
+            for(int k=0; k<D; k++)
+            {
+                dx[k] = xj[k] - x[k][si];
+                where(dx[k] >= Lover2, dx[k]) -= L;
+                where(dx[k] < -Lover2, dx[k]) += L;
+                d2 += dx[k]*dx[k];
+            }
+
+            vmask neighbors = d2 < rn2;
+            if(cj == ci) neighbors = neighbors && (lane > (double)l);    // Each pair once within a cluster
+            if(none_of(neighbors)) continue;                            // Most rows are out of range
+
+            vdouble sumR = Rj + R[si];
+            vmask overlaps = neighbors && (d2 < sumR*sumR);
+
+            vdouble overlap = 0.0;
+            where(overlaps, overlap) = sumR/sqrt(d2) - 1.0;
+
+            for(int k=0; k<D; k++)                                      // Spring repulsion force, watch the sign
+            {
+                vdouble f = overlap*dx[k];
+                Fi[l][k] -= f;
+                Fj[k] += f;
+            }
+
+            for(int k=0; k<D; k++)                                      // Add up directions of neighbors
+            {
+                where(neighbors, ui_sum[l][k]) += uj[k];
+                where(neighbors, uj_sum[k]) += u[k][si];
+            }
+
+            if(film)
+            {
+                overi[l] += overlap;
+                overj += overlap;
+            }
+        }
+
+        for(int k=0; k<D; k++)
+        {
+            vdouble f(&F[k][sj], stdx::element_aligned);
+            vdouble s(&u_sum[k][sj], stdx::element_aligned);
+            f += Fj[k];
+            s += uj_sum[k];
+            f.copy_to(&F[k][sj], stdx::element_aligned);
+            s.copy_to(&u_sum[k][sj], stdx::element_aligned);
+        }
+
+        if(film)
+        {
+            vdouble o(&over[sj], stdx::element_aligned);
+            o += 240*overj;
+            o.copy_to(&over[sj], stdx::element_aligned);
+        }
+    }
+
+    for(int l=0; l<W; l++)
+    {
+        int si = ci*W + l;
+        for(int k=0; k<D; k++)
+        {
+            F[k][si] += reduce(Fi[l][k]);
+            u_sum[k][si] += reduce(ui_sum[l][k]);
+        }
+        if(film) over[si] += 240*reduce(overi[l]);
+    }
+}
+
+template <int D>
+void Clusters<D>::scatter(Cells<D> &cell, bool film)
+// Add the forces and direction sums back to the cells.
+{
+    int nslots = nclusters*W;
+    for(int s=0; s<nslots; s++)
+    {
+        int i = member[s];
+        if(i < 0) continue;
+
+        for(int k=0; k<D; k++)
+        {
+            cell.F[k][i] += F[k][s];
+            cell.u_new[k][i] += u_sum[k][s];
+        }
+
+        if(film) cell.over[i] -= over[s];
+    }
+}
+
+template <int D>
+void Clusters<D>::save(Checkpoint &file)
+// The grouping and the cluster pairs. Positions and sums are gathered again at every step.
+{
+    file.put(nclusters);
+    file.put(boxStart);
+    file.put(pairStart);
+    file.put(pairs);
+    file.put(member);
+    file.put(R);
+}
+
+template <int D>
+void Clusters<D>::load(Checkpoint &file)
+{
+    file.get(nclusters);
+    file.get(boxStart);
+    file.get(pairStart);
+    file.get(pairs);
+    file.get(member);
+    file.get(R);
+
+    int nslots = nclusters*W;
+    over.assign(nslots, 0.0);
+    for(int k=0; k<D; k++)
+    {
+        x[k].resize(nslots);
+        for(int s=0; s<nslots; s++) x[k][s] = 1e6 + 1e3*s;
+        u[k].assign(nslots, 0.0);
+        F[k].assign(nslots, 0.0);
+        u_sum[k].assign(nslots, 0.0);
+    }
+}
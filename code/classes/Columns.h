@@ -0,0 +1,129 @@
+
+// *** Time series as binary columns ***
+
+// With "--series binary" the COM, order parameter, orientation and MSD go into dat/series.bin
+// instead of their text files. The file starts with a header of headerBytes: a line with
+// "JAMSERIES1" and a line of JSON with the run parameters, the sampling stride and, for every
+// column, its name, NumPy dtype and byte offset, padded with spaces. Each column then holds one
+// value per sampled step, row r for step r*stride, so NumPy can memory-map a column directly:
+//
+//     meta = json.loads(open(name, "rb").read(4096).split(b"\n")[1])
+//     c = meta["columns"][k]
+//     np.memmap(name, dtype=c["dtype"], mode="r", offset=c["offset"], shape=(meta["rows"],))
+//
+// The file is laid out in full when the run starts. Rows not written yet hold NaN, and -1 in the
+// step column. Values are written in place by their step, so a restarted run simply writes its
+// rows again.
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <limits>
+
+struct Columns
+{
+    Columns();
+
+    void create(string, string, long int, long int, vector<string>&);
+    void open(string, long int, long int, vector<string>&);
+    void set(int, long int, double);
+    void flush();
+
+    bool active;
+
+    static const long int headerBytes = 4096;
+
+private:
+    fstream file;
+    string name;
+    long int rows, stride;
+    int columns;                        // Not counting the step column, which comes first
+
+    void fail(string, int);
+};
+
+Columns::Columns()
+{
+    active = false;
+    rows = 0;
+    stride = 1;
+    columns = 0;
+}
+
+void Columns::fail(string what, int status)
+{
+    cout << what << " " << name << ". Status " << status << "\n";
+    exit(status);
+}
+
+void Columns::create(string name_, string parameters, long int rows_, long int stride_, vector<string> &names)
+// parameters is a list of "key": value pairs for the header. names are the columns after the step.
+{
+    name = name_;
+    rows = rows_;
+    stride = stride_;
+    columns = names.size();
+
+    const int one = 1;
+    const char *order = (*(const char*)&one == 1) ? "<" : ">";
+
+    ostringstream json;
+    json << setprecision(17) << "{" << parameters << ", \"stride\": " << stride << ", \"rows\": " << rows
+         << ", \"columns\": [{\"name\": \"t\", \"dtype\": \"" << order << "i8\", \"offset\": " << headerBytes << "}";
+    for(int c=0; c<columns; c++)
+    {
+        json << ", {\"name\": \"" << names[c] << "\", \"dtype\": \"" << order << "f8\", \"offset\": "
+             << headerBytes + (c+1)*rows*8 << "}";
+    }
+    json << "]}";
+
+    string header = "JAMSERIES1\n" + json.str() + "\n";
+    if((long int)header.size() > headerBytes) fail("Too many columns for the header of", 744);
+    header.resize(headerBytes-1, ' ');
+    header += "\n";
+
+    file.open(name.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!file) fail("Cannot write", 744);
+    file.write(header.data(), headerBytes);
+
+    vector<int64_t> noStep(rows, -1);
+    vector<double> noValue(rows, numeric_limits<double>::quiet_NaN());
+    file.write(reinterpret_cast<const char*>(noStep.data()), rows*8);
+    for(int c=0; c<columns; c++) file.write(reinterpret_cast<const char*>(noValue.data()), rows*8);
+    file.close();
+
+    open(name, rows, stride, names);
+}
+
+void Columns::open(string name_, long int rows_, long int stride_, vector<string> &names)
+// Write into a file made by create with the same rows, stride and columns.
+{
+    name = name_;
+    rows = rows_;
+    stride = stride_;
+    columns = names.size();
+
+    file.open(name.c_str(), ios::in | ios::out | ios::binary);
+    file.seekg(0, ios::end);
+    if(!file || (long int)file.tellg() != headerBytes + (columns+1)*rows*8) fail("Cannot write", 744);
+    active = true;
+}
+
+void Columns::set(int column, long int t, double value)
+// The value of a column at step t. The step column is filled in along with it.
+{
+    if(t%stride != 0 || t/stride >= rows) return;
+    long int row = t/stride;
+
+    int64_t step = t;
+    file.seekp(headerBytes + row*8);
+    file.write(reinterpret_cast<const char*>(&step), 8);
+    file.seekp(headerBytes + ((column+1)*rows + row)*8);
+    file.write(reinterpret_cast<const char*>(&value), 8);
+}
+
+void Columns::flush()
+{
+    if(active) file.flush();
+}
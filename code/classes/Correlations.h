@@ -3,17 +3,24 @@
 // **** Methods for calculating correlation functions and velocity distribution ***
 // ********************************************************************************
 
-// *** Gets NDIM from definition in main ***
+// *** Templated on the number of dimensions D ***
 
+template <int D>
 struct Correlations
 {
     Correlations(double, double, double, double, long int, double);
     
-    void spatialCorrelations(vector<vector<int>>&, vector<Box>&, vector<Cell>&);
-    void autocorrelation(int, vector<double>& );
-    void velDist(vector<Cell>&);
+    void spatialCorrelations(const vector<vector<int>>&, CellList&, Cells<D>&);
+    void meshCorrelations(Cells<D>&);
+    void shortPairs(Cells<D>&, double, vector<double>&);
+    void autocorrelation(int, std::array<double, D>& );
+    void startMultiTau(bool, bool);
+    void multiTauStep(std::array<double, D>&, Cells<D>&);
+    void velDist(Cells<D>&);
     
-    void printCorrelations(int, Print&);
+    void printCorrelations(int, Print<D>&);
+    void save(Checkpoint&);
+    void load(Checkpoint&);
     double delta_norm(double);
     
     double L, Lover2, dens;
@@ -30,16 +37,31 @@ struct Correlations
     int noBins;
     double norm;
     
-    vector<double> orientation0;
+    bool mesh;                          // Spatial correlations from FFTs on a mesh instead of sums over pairs
+    int threads;                        // OpenMP threads for the sums over pairs
+    double meshSpacing;                 // Largest mesh spacing
+    int maxMesh;                        // Most mesh points along an axis, a power of two
+    double dk;                          // Bin width of the structure factor
+    
+    std::array<double, D> orientation0;
     vector<double> orientationCorrelation;
     vector<double> velocityCorrelation;
     vector<double> pairCorrelationValues;
     vector<double> autocorrelationValues;
     vector<double> velocityDistributionValues;
+    vector<double> structureFactorValues;
+    
+    bool orientationMultiTau;           // Autocorrelation of the system orientation at all lags
+    bool velocityMultiTau;              // Velocity autocorrelation of the cells at all lags
+    MultiTau orientationCorrelator;
+    MultiTau velocityCorrelator;
+    AveragedMSD<D> averagedMSD;         // MSD over all time origins, from the positions kept along the run
+    vector<double> velocities;          // Velocities of the cells by index, for the correlator
     
 };
 
-Correlations::Correlations(double L_, double dens_, double cut, double time, long int N_, double CFself_)
+template <int D>
+Correlations<D>::Correlations(double L_, double dens_, double cut, double time, long int N_, double CFself_)
 {
     N = N_;
     L = L_;
@@ -55,11 +77,20 @@ Correlations::Correlations(double L_, double dens_, double cut, double time, lon
     np = (int)ceil(cutoff/dr_p);
     nc = (int)ceil(cutoff/dr_c);
     noBins = 100;
+    
+    mesh = false;
+    orientationMultiTau = false;
+    velocityMultiTau = false;
+    threads = 1;
+    meshSpacing = 0.5;
+    if constexpr (D==2) maxMesh = 4096;
+    if constexpr (D==3) maxMesh = 256;
+    dk = 2*PI/L;
 
-    if(NDIM == 2) norm = 2*L*L/(2*PI*dr_p*(double)(N*N));
-    if(NDIM == 3) norm = 2*L*L*L/(4*PI*dr_p*(double)(N*N));
+    if constexpr (D==2) norm = 2*L*L/(2*PI*dr_p*(double)(N*N));
+    if constexpr (D==3) norm = 2*L*L*L/(4*PI*dr_p*(double)(N*N));
     
-    orientation0.assign(NDIM,0);
+    orientation0.fill(0);
     
     orientationCorrelation.assign(nc, 0);
     velocityCorrelation.assign(nc,0);
@@ -68,37 +99,75 @@ Correlations::Correlations(double L_, double dens_, double cut, double time, lon
     velocityDistributionValues.assign(noBins,0);
 }
 
-void Correlations::spatialCorrelations
-    (vector<vector<int>> &boxPairs, vector<Box> &grid, vector<Cell> &cell)
+template <int D>
+void Correlations<D>::spatialCorrelations
+    (const vector<vector<int>> &boxPairs, CellList &boxCells, Cells<D> &cell)
 // We normalize the velocity correlations by the number of counts in the bin size. The pair
 // correlation normalization is geometric and depends on the system dimension.
 {
+    if(mesh)
+    {
+        meshCorrelations(cell);
+        return;
+    }
+    
     vector<double> pairTemp(np,0.0);
     vector<double> corrTemp(nc,0.0);
     vector<double> velTemp(nc,0.0);
     vector<double> counts(nc,0.0);
-
-    for (int a=0; a<boxPairs.size(); a++)
+    
+    // Normalised velocities, once per cell rather than once per pair
+    
+    std::array<vector<double>, D> direction;
+    for(int k=0; k<D; k++) direction[k].resize(cell.N);
+    for(int i=0; i<cell.N; i++)
+    {
+        double inverseSpeed = 1.0/cell.get_speed(i);
+        for(int k=0; k<D; k++) direction[k][i] = cell.v[k][i]*inverseSpeed;
+    }
+    
+    // Box pairs are handed out to the threads one after the other, the ones with the most pairs
+    // of cells first, so that the threads run out of work at about the same time. Each thread
+    // fills histograms of its own, which are added up at the end.
+    
+    vector<long int> work(boxPairs.size());
+    vector<int> order(boxPairs.size());
+    for(size_t a=0; a<boxPairs.size(); a++)
+    {
+        work[a] = (long int)boxCells.size(boxPairs[a][0])*boxCells.size(boxPairs[a][1]);
+        order[a] = a;
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b){ return work[a] > work[b]; });
+    
+    double *pairSum = pairTemp.data(), *corrSum = corrTemp.data(), *velSum = velTemp.data(), *countSum = counts.data();
+    int np_ = np, nc_ = nc;
+    
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(threads) \
+            reduction(+:pairSum[:np_], corrSum[:nc_], velSum[:nc_], countSum[:nc_])
+    for (size_t o=0; o<order.size(); o++)
     {
+        int a = order[o];
         int p = boxPairs[a][0];
         int q = boxPairs[a][1];
-        int maxp = grid[p].CellList.size();
-        int maxq = grid[q].CellList.size();
+        int maxp = boxCells.size(p);
+        int maxq = boxCells.size(q);
+        int *inP = boxCells.cells(p);
+        int *inQ = boxCells.cells(q);
         
         for (int m=0; m<maxp; m++)
         {
             for (int n=0; n<maxq; n++)
             {
-                int i = grid[p].CellList[m];
-                int j = grid[q].CellList[n];
+                int i = inP[m];
+                int j = inQ[n];
                 
                 // Avoid double-counting pairs in the same box.
                 
                 if( p!=q || (p==q && j>i) )
                 {
                     double r = 0.0;
-                    for(int k=0; k<NDIM; k++){
-                        double dk = delta_norm(cell[j].x[k]-cell[i].x[k]);
+                    for(int k=0; k<D; k++){
+                        double dk = delta_norm(cell.x[k][j]-cell.x[k][i]);
                         r += dk*dk;
                     }
                     
@@ -109,42 +178,25 @@ void Correlations::spatialCorrelations
                     
                     // Exclude any pairs beyond cutoff, normalize.
                     
-                    if(binp < np)
+                    if(binp < np_)
                     {
-                        if(NDIM == 2) pairTemp[binp] += 1.0/r;
-                        if(NDIM == 3) pairTemp[binp] += 1.0/(r*r);
+                        if constexpr (D==2) pairSum[binp] += 1.0/r;
+                        if constexpr (D==3) pairSum[binp] += 1.0/(r*r);
                     }
                     
-                    if(binc < nc)
+                    if(binc < nc_)
                     {
-                    	counts[binc] += 1.0;
+                    	countSum[binc] += 1.0;
 						
-                        double vxi = cell[i].vx;
-                        double vyi = cell[i].vy;
-                        double vxj = cell[j].vx;
-                        double vyj = cell[j].vy;
-                        
-                        if(NDIM == 2)
+                        double vivj = 0.0;
+                        double uiuj = 0.0;
+                        for(int k=0; k<D; k++)
                         {
-                            corrTemp[binc] += cell[i].cosp*cell[j].cosp
-											+ cell[i].sinp*cell[j].sinp;
-                            velTemp[binc] +=
-                            		(vxi*vxj+vyi*vyj)/(cell[i].get_speed()*cell[j].get_speed());
-                        }
-                        if(NDIM == 3)
-                        {
-                        	double ti = cell[i].theta;
-                        	double tj = cell[j].theta;
-                        	double pi = cell[i].phi;
-                        	double pj = cell[i].phi;
-							
-                            corrTemp[binc] += ( cos(ti)*cos(tj) + cos(pi-pj)*sin(ti)*sin(tj) ) ;
-							
-							double vzi = cell[i].vz;
-                            double vzj = cell[j].vz;
-                            velTemp[binc] +=
-                                (vxi*vxj+vyi*vyj+vzi*vzj)/(cell[i].get_speed()*cell[j].get_speed());
+                            vivj += direction[k][i]*direction[k][j];
+                            uiuj += cell.u[k][i]*cell.u[k][j];
                         }
+                        velSum[binc] += vivj;
+                        corrSum[binc] += uiuj;
                     }
                 }
             }
@@ -166,27 +218,363 @@ void Correlations::spatialCorrelations
 	}
 }
 
-void Correlations::autocorrelation(int t, vector<double>&orientation)
+template <int D>
+void Correlations<D>::meshCorrelations(Cells<D> &cell)
+// The same correlation functions from fields on a mesh, in O(M log M) for M mesh points instead
+// of a sum over all pairs within the cutoff. Density, normalised velocity and orientation are
+// spread onto the mesh cloud-in-cell, and the sum over pairs of a field at separation r is the
+// inverse transform of its power spectrum. The part of that sum that pairs a cell with itself is
+// known exactly and taken out. The results are averaged over the mesh points of each bin, which
+// smooths them over a few mesh spacings; the pair correlation at short range, where that matters,
+// is summed over pairs instead. The power spectrum of the density also gives the structure
+// factor S(k).
+{
+    int M = 4;
+    while(L/M > meshSpacing && M < maxMesh) M *= 2;
+    double h = L/M;
+    
+    FFT fft(M, D);
+    long int size = fft.size;
+    
+    // Each cell is shared among the 2^D mesh points around it, with weights linear in the
+    // distance from them.
+    
+    vector<std::array<int, D>> base(cell.N);
+    vector<std::array<double, D>> frac(cell.N);
+    for(int i=0; i<cell.N; i++)
+    {
+        for(int k=0; k<D; k++)
+        {
+            double s = (cell.x[k][i] + Lover2)/h;
+            double b = floor(s);
+            frac[i][k] = s - b;
+            base[i][k] = (((int)b)%M + M)%M;
+        }
+    }
+    
+    // Fields: the density, then the components of the normalised velocity and the orientation.
+    // Their power spectra are summed into density, velocity and orientation.
+    
+    auto value = [&](int field, int i) -> double
+    {
+        if(field == 0) return 1.0;
+        if(field <= D) return cell.v[field-1][i]/cell.get_speed(i);
+        return cell.u[field-1-D][i];
+    };
+    
+    int selfPoints = (D==2) ? 9 : 27;
+    vector<vector<double>> power(3, vector<double>(size, 0.0));
+    vector<vector<double>> self(3, vector<double>(selfPoints, 0.0));
+    vector<complex<double>> grid(size);
+    
+    // The fields are real, so two of them share one transform, one as the real and one as the
+    // imaginary part, and are told apart by the symmetry between k and -k.
+    
+    auto group = [&](int field) { return (field == 0) ? 0 : (field <= D ? 1 : 2); };
+    
+    auto negative = [&](long int p)
+    {
+        long int q = 0, stride = 1;
+        for(int k=0; k<D; k++, p/=M, stride*=M) q += ((M - p%M)%M)*stride;
+        return q;
+    };
+    
+    for(int first=0; first<=2*D; first+=2)
+    {
+        int last = min(first+1, 2*D);
+        fill(grid.begin(), grid.end(), complex<double>(0.0, 0.0));
+        
+        for(int field=first; field<=last; field++)
+        {
+            for(int i=0; i<cell.N; i++)
+            {
+                double a = value(field, i);
+                complex<double> part = (field == first) ? complex<double>(a, 0.0) : complex<double>(0.0, a);
+                
+                for(int c=0; c<(1<<D); c++)
+                {
+                    double w = 1.0;
+                    long int p = 0, stride = 1;
+                    for(int k=0; k<D; k++)
+                    {
+                        int up = (c >> k) & 1;
+                        w *= up ? frac[i][k] : 1.0-frac[i][k];
+                        p += ((base[i][k]+up)%M)*stride;
+                        stride *= M;
+                    }
+                    grid[p] += w*part;
+                }
+                
+                // A cell paired with itself, at separations of -1, 0 and 1 mesh spacings per axis
+                
+                for(int n=0; n<selfPoints; n++)
+                {
+                    double w = a*a;
+                    for(int k=0, m=n; k<D; k++, m/=3)
+                    {
+                        double f = frac[i][k];
+                        w *= (m%3 == 1) ? (1.0-f)*(1.0-f) + f*f : f*(1.0-f);
+                    }
+                    self[group(field)][n] += w;
+                }
+            }
+        }
+        
+        fft.transform(grid, false);
+        
+        for(long int p=0; p<size; p++)
+        {
+            complex<double> f = grid[p], g = conj(grid[negative(p)]);
+            power[group(first)][p] += 0.25*std::norm(f + g);
+            if(last != first) power[group(last)][p] += 0.25*std::norm(f - g);
+        }
+    }
+    
+    // Mesh points by separation, taking the nearest image
+    
+    auto separation = [&](long int p, std::array<int, D> &n) -> double
+    {
+        double n2 = 0.0;
+        for(int k=0; k<D; k++, p/=M)
+        {
+            n[k] = p%M;
+            if(n[k] > M/2) n[k] -= M;
+            n2 += n[k]*n[k];
+        }
+        return sqrt(n2);
+    };
+    
+    // Structure factor S(k) = |rho_k|^2/N, corrected for the smoothing of the cloud-in-cell
+    // weights and averaged over shells of width dk
+    
+    int nk = M/2;
+    vector<double> sTemp(nk, 0.0), sCounts(nk, 0.0);
+    for(long int p=1; p<size; p++)
+    {
+        std::array<int, D> n;
+        int bin = (int)floor(separation(p, n) + 0.5);
+        if(bin >= nk) continue;
+        
+        double window = 1.0;
+        for(int k=0; k<D; k++)
+        {
+            double x = PI*n[k]/M;
+            if(n[k] != 0) window *= pow(sin(x)/x, 2);
+        }
+        sTemp[bin] += power[0][p]/(N*window*window);
+        sCounts[bin] += 1.0;
+    }
+    structureFactorValues.resize(nk, 0.0);
+    for(int k=1; k<nk; k++) if(sCounts[k] > 0) structureFactorValues[k] += sTemp[k]/sCounts[k];
+    
+    // Sums over pairs at each separation, without the cells paired with themselves. The power
+    // spectra are real and even, so their transforms are real, and two are done at once. The
+    // sums replace the spectra.
+    
+    for(int g=0; g<3; g+=2)
+    {
+        if(g == 0) for(long int p=0; p<size; p++) grid[p] = complex<double>(power[0][p], power[1][p]);
+        else       for(long int p=0; p<size; p++) grid[p] = power[2][p];
+        fft.transform(grid, true);
+        
+        for(long int p=0; p<size; p++)
+        {
+            power[g][p] = grid[p].real()/size;
+            if(g == 0) power[1][p] = grid[p].imag()/size;
+        }
+    }
+    
+    for(int g=0; g<3; g++)
+    {
+        for(int n=0; n<selfPoints; n++)
+        {
+            long int p = 0, stride = 1;
+            for(int k=0, m=n; k<D; k++, m/=3)
+            {
+                p += ((m%3 - 1 + M)%M)*stride;
+                stride *= M;
+            }
+            power[g][p] -= self[g][n];
+        }
+    }
+    double volume = pow(L, D);
+    double cellVolume = pow(h, D);
+    
+    // The mesh smooths the pair correlation over a few mesh spacings, and bins of dr_p hold few
+    // mesh points or none. So it is binned in widths of at least one mesh spacing, and over the
+    // first five cell diameters, where the peaks are sharp, it comes from a sum over pairs.
+    
+    double exactRange = min(cutoff, max(10.0, 16.0*h));
+    double width = dr_p*ceil(h/dr_p);
+    int nw = (int)ceil(cutoff/width);
+    
+    vector<double> pairTemp(nw, 0.0), pairCounts(nw, 0.0);
+    vector<double> corrTemp(nc, 0.0), velTemp(nc, 0.0), counts(nc, 0.0);
+    
+    for(long int p=0; p<size; p++)
+    {
+        std::array<int, D> n;
+        double r = h*separation(p, n);
+        
+        int binp = (int)floor(r/width);
+        int binc = (int)floor(r/dr_c);
+        
+        if(binp < nw)
+        {
+            pairTemp[binp] += power[0][p]*volume/((double)N*N*cellVolume);
+            pairCounts[binp] += 1.0;
+        }
+        if(binc < nc)
+        {
+            counts[binc] += power[0][p];
+            velTemp[binc] += power[1][p];
+            corrTemp[binc] += power[2][p];
+        }
+    }
+    
+    for(int k=0; k<nc; k++)
+    {
+        orientationCorrelation[k] += corrTemp[k]/counts[k];
+        velocityCorrelation[k] += velTemp[k]/counts[k];
+    }
+    
+    vector<double> exact(np, 0.0);
+    shortPairs(cell, exactRange, exact);
+    
+    for(int k=0; k<np; k++)
+    {
+        if((k+1)*dr_p <= exactRange)
+        {
+            pairCorrelationValues[k] += exact[k];
+            continue;
+        }
+        int w = (int)floor((k+0.5)*dr_p/width);
+        if(w < nw && pairCounts[w] > 0) pairCorrelationValues[k] += pairTemp[w]/pairCounts[w];
+    }
+}
+
+template <int D>
+void Correlations<D>::shortPairs(Cells<D> &cell, double range, vector<double> &pairs)
+// The pair correlation up to range from a sum over pairs, normalised as in spatialCorrelations.
+// The cells are binned into boxes of at least range, so only the neighbouring boxes are searched,
+// or all cells if the box is too small for three of them.
+{
+    int b = max(1, (int)floor(L/range));
+    if(b < 3) b = 1;
+    double side = L/b;
+    int nbox = 1;
+    for(int k=0; k<D; k++) nbox *= b;
+    
+    ivec box(cell.N);
+    for(int i=0; i<cell.N; i++)
+    {
+        int p = 0, stride = 1;
+        for(int k=0; k<D; k++, stride*=b)
+        {
+            int c = (int)((cell.x[k][i] + Lover2)/side);
+            p += min(max(c, 0), b-1)*stride;
+        }
+        box[i] = p;
+    }
+    CellList boxCells;
+    boxCells.sort(box, nbox);
+    
+    int neighbours = (b == 1) ? 1 : ((D==2) ? 9 : 27);
+    double *pairSum = pairs.data();
+    int np_ = np;
+    
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(threads) reduction(+:pairSum[:np_])
+    for(int i=0; i<cell.N; i++)
+    {
+        for(int m=0; m<neighbours; m++)
+        {
+            int q = 0, stride = 1;
+            for(int k=0, rest=m, p=box[i]; k<D; k++, rest/=3, p/=b, stride*=b)
+            {
+                int c = (b == 1) ? 0 : (p%b + rest%3 - 1 + b)%b;
+                q += c*stride;
+            }
+            
+            int *inQ = boxCells.cells(q);
+            for(int n=0; n<boxCells.size(q); n++)
+            {
+                int j = inQ[n];
+                if(j <= i) continue;
+                
+                double r = 0.0;
+                for(int k=0; k<D; k++)
+                {
+                    double dk = delta_norm(cell.x[k][j]-cell.x[k][i]);
+                    r += dk*dk;
+                }
+                r = sqrt(r);
+                
+                int binp = (int)floor(r/dr_p);
+                if(r >= range || binp >= np_) continue;
+                if constexpr (D==2) pairSum[binp] += 1.0/r;
+                if constexpr (D==3) pairSum[binp] += 1.0/(r*r);
+            }
+        }
+    }
+    
+    for(int k=0; k<np; k++) pairs[k] *= norm;
+}
+
+template <int D>
+void Correlations<D>::autocorrelation(int t, std::array<double, D> &orientation)
 {
     double value = 0.0;
-    for(int k=0; k<NDIM; k++)
+    for(int k=0; k<D; k++)
     {
     	value += orientation0[k]*orientation[k];
 	}
     autocorrelationValues[t] += value;
 }
 
-void Correlations::velDist(vector<Cell> &cell)
+template <int D>
+void Correlations<D>::startMultiTau(bool orientation, bool velocity)
+// Correlate at every step from now on, the system orientation and, if asked for, the velocities
+// of all cells. The velocity correlator keeps 16 samples of every cell per level, and averages
+// blocks of 4 to save memory, as it needs N*D*16*8 bytes for each of about log4(steps/16) levels.
+{
+    orientationMultiTau = orientation || velocity;
+    velocityMultiTau = velocity;
+    
+    if(orientationMultiTau) orientationCorrelator.setup(D, 16, 2);
+    if(velocityMultiTau) velocityCorrelator.setup(N*D, 16, 4);
+}
+
+template <int D>
+void Correlations<D>::multiTauStep(std::array<double, D> &orientation, Cells<D> &cell)
+// Velocities are passed on by the index of the cell, whatever order they are stored in. All cells
+// must be in this process.
+{
+    orientationCorrelator.add(orientation.data());
+    
+    if(velocityMultiTau)
+    {
+        velocities.resize(N*D);
+        for(int i=0; i<cell.N; i++)
+        {
+            for(int k=0; k<D; k++) velocities[(long int)cell.index[i]*D+k] = cell.v[k][i];
+        }
+        velocityCorrelator.add(velocities.data());
+    }
+}
+
+template <int D>
+void Correlations<D>::velDist(Cells<D> &cell)
 {
     for(int i=0; i<N; i++)
     {
-        double v = cell[i].get_speed();
+        double v = cell.get_speed(i);
         int binv = (int)floor(v/dv);
         if(binv < noBins) velocityDistributionValues[binv] += 1.0/(double)N;
     }
 }
 
-void Correlations::printCorrelations(int timeAvg, Print &print)
+template <int D>
+void Correlations<D>::printCorrelations(int timeAvg, Print<D> &print)
 {
     for(int k=0; k<velocityCorrelation.size(); k++)
         print.print_corr(dr_c*(k+1), velocityCorrelation[k]/timeAvg);
@@ -202,9 +590,25 @@ void Correlations::printCorrelations(int timeAvg, Print &print)
     
     for(int k=0; k<velocityDistributionValues.size(); k++)
         print.print_velDist(k*dv, velocityDistributionValues[k]/timeAvg);
+    
+    for(size_t k=1; k<structureFactorValues.size(); k++)
+        print.print_structureFactor(k*dk, structureFactorValues[k]/timeAvg);
+    
+    vector<long int> lag;
+    vector<double> value;
+    
+    if(orientationMultiTau) orientationCorrelator.results(lag, value);
+    for(size_t m=0; m<lag.size() && orientationMultiTau; m++) print.print_autoCorrMultiTau(lag[m], value[m]);
+    
+    if(velocityMultiTau) velocityCorrelator.results(lag, value);
+    for(size_t m=0; m<lag.size() && velocityMultiTau; m++) print.print_vaf(lag[m], value[m]/N);
+    
+    if(averagedMSD.active) averagedMSD.results(lag, value, threads);
+    for(size_t m=0; m<lag.size() && averagedMSD.active; m++) print.print_MSDAveraged(lag[m], value[m]);
 }
 
-double Correlations::delta_norm(double delta)
+template <int D>
+double Correlations<D>::delta_norm(double delta)
 // Subtracts multiples of the box size to account for periodic boundary conditions
 {
     int k=-1;
@@ -213,3 +617,34 @@ double Correlations::delta_norm(double delta)
     
     return delta;
 }
+
+template <int D>
+void Correlations<D>::save(Checkpoint &file)
+// The sums over the measurements so far
+{
+    file.put(orientation0);
+    file.put(orientationCorrelation);
+    file.put(velocityCorrelation);
+    file.put(pairCorrelationValues);
+    file.put(autocorrelationValues);
+    file.put(velocityDistributionValues);
+    file.put(structureFactorValues);
+    orientationCorrelator.save(file);
+    velocityCorrelator.save(file);
+    averagedMSD.save(file);
+}
+
+template <int D>
+void Correlations<D>::load(Checkpoint &file)
+{
+    file.get(orientation0);
+    file.get(orientationCorrelation);
+    file.get(velocityCorrelation);
+    file.get(pairCorrelationValues);
+    file.get(autocorrelationValues);
+    file.get(velocityDistributionValues);
+    file.get(structureFactorValues);
+    orientationCorrelator.load(file);
+    velocityCorrelator.load(file);
+    averagedMSD.load(file);
+}
@@ -0,0 +1,405 @@
+
+// ********************************************************************************
+// **** Domain decomposition over MPI processes                                  ***
+// ********************************************************************************
+
+// *** Templated on the number of dimensions D ***
+
+// With more than one MPI process, the periodic box is cut along its last axis into slabs of
+// whole box layers, one slab per process. Each process stores the cells it owns first, cell.N
+// of them, followed by ghost copies of the cells in the layer just below and just above its
+// slab. A box layer is at least 2*rn wide, wider than the skin radius, so the ghosts include
+// every cell that can come within rs of an own cell before the next list refresh.
+//
+// At a list refresh, cells that have left the slab are handed over to the neighboring process
+// and the ghosts are collected again. Between refreshes only the ghosts' positions and
+// directions are sent. Build with mpicxx -DUSE_MPI; without it there is a single domain and
+// nothing is sent.
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+inline void globalSum(double *a, int n)
+// Add up a[0] ... a[n-1] over all processes, in place.
+{
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, a, n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+}
+
+inline double globalSum(double a)
+{
+    globalSum(&a, 1);
+    return a;
+}
+
+template <int D>
+struct Domain
+{
+    Domain();
+
+    void setup(int, double, double);
+    int layer(double);
+    int firstLayer(int r) { return (long int)b*r/size; }
+    int owner(int);
+    bool owns(double z) { int l = layer(z); return l >= lo && l < hi; }
+
+    void migrate(Cells<D>&);
+    void exchangeGhosts(Cells<D>&);
+    void updateGhosts(Cells<D>&);
+    void gather(Cells<D>&, Cells<D>&);
+    void largestTwo(double&, double&);
+    void broadcast(uint64_t&);
+
+    int rank, size;                     // This process, number of processes
+    int below, above;                   // Processes owning the slabs below and above, periodically
+    int b;                              // Number of box layers
+    int lo, hi;                         // This process owns layers lo ... hi-1
+    double lp, Lover2;
+
+    vector<int> sendBelow;              // Own cells in layer lo, ghosts on the process below
+    vector<int> sendAbove;              // Own cells in layer hi-1, ghosts on the process above
+    int ghostsBelow, ghostsAbove;       // Ghosts received from below, then from above
+
+private:
+    void pack(Cells<D>&, vector<int>&, vector<double>&, bool);
+    void unpack(Cells<D>&, int, vector<double>&, bool);
+    void exchange(int, vector<double>&, int, vector<double>&);
+
+    vector<double> sendBuffer, recvBuffer;
+};
+
+template <int D>
+Domain<D>::Domain()
+{
+    rank = 0;
+    size = 1;
+#ifdef USE_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+    below = above = rank;
+    b = 1;
+    lo = 0;
+    hi = 1;
+    lp = 1.0;
+    Lover2 = 0.5;
+    ghostsBelow = ghostsAbove = 0;
+}
+
+template <int D>
+void Domain<D>::setup(int layers, double lp_, double Lover2_)
+// Divide the layers as evenly as possible over the processes.
+{
+    b = layers;
+    lp = lp_;
+    Lover2 = Lover2_;
+
+    if(size > 1 && (b < 3 || size > b))
+    {
+        if(rank == 0) cout << "Domain decomposition needs at least 3 box layers and one layer per process, have "
+                           << b << " layers for " << size << " processes. Status 720\n";
+#ifdef USE_MPI
+        MPI_Abort(MPI_COMM_WORLD, 720);
+#endif
+    }
+
+    lo = firstLayer(rank);
+    hi = firstLayer(rank+1);
+    below = (rank-1+size)%size;
+    above = (rank+1)%size;
+}
+
+template <int D>
+inline int Domain<D>::layer(double z)
+// Same rounding as the box assignment in the Engine
+{
+    int c = (int)((z + Lover2)/lp);
+    if(c >= b)     c = b-1;
+    else if(c < 0) c = 0;
+    return c;
+}
+
+template <int D>
+int Domain<D>::owner(int l)
+// The last process whose first layer is at or below l
+{
+    return ((long int)(l+1)*size - 1)/b;
+}
+
+template <int D>
+void Domain<D>::pack(Cells<D> &cell, vector<int> &list, vector<double> &buffer, bool all)
+// Everything about the listed cells for a hand-over, or only what a ghost needs.
+{
+    buffer.clear();
+    for(size_t n=0; n<list.size(); n++)
+    {
+        int i = list[n];
+        buffer.push_back(cell.index[i]);
+        buffer.push_back(cell.R[i]);
+        for(int k=0; k<D; k++)
+        {
+            buffer.push_back(cell.x[k][i]);
+            buffer.push_back(cell.u[k][i]);
+            if(all)
+            {
+                buffer.push_back(cell.x_real[k][i]);
+                buffer.push_back(cell.x0[k][i]);
+                buffer.push_back(cell.x_old[k][i]);
+                buffer.push_back(cell.v[k][i]);
+            }
+        }
+    }
+}
+
+template <int D>
+void Domain<D>::unpack(Cells<D> &cell, int first, vector<double> &buffer, bool all)
+// Store the cells in buffer from position first onwards. The arrays must be large enough.
+{
+    int stride = all ? 2+6*D : 2+2*D;
+    int n = buffer.size()/stride;
+
+    for(int m=0; m<n; m++)
+    {
+        int i = first+m;
+        double *c = &buffer[m*stride];
+
+        cell.index[i] = (int)c[0];
+        cell.R[i] = c[1];
+        cell.Rinv[i] = 1.0/c[1];
+        cell.over[i] = 0;
+        cell.box[i] = -1;
+        c += 2;
+        for(int k=0; k<D; k++)
+        {
+            cell.x[k][i] = *c++;
+            cell.u[k][i] = *c++;
+            cell.u_new[k][i] = cell.u[k][i];
+            cell.F[k][i] = 0.0;
+            if(all)
+            {
+                cell.x_real[k][i] = *c++;
+                cell.x0[k][i] = *c++;
+                cell.x_old[k][i] = *c++;
+                cell.v[k][i] = *c++;
+            }
+            else
+            {
+                cell.v[k][i] = 0.0;
+            }
+        }
+    }
+}
+
+template <int D>
+void Domain<D>::exchange(int to, vector<double> &send, int from, vector<double> &recv)
+// Send to one process while receiving from another. The sizes are exchanged first.
+{
+#ifdef USE_MPI
+    int nsend = send.size();
+    int nrecv = 0;
+    MPI_Sendrecv(&nsend, 1, MPI_INT, to, 0, &nrecv, 1, MPI_INT, from, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    recv.resize(nrecv);
+    MPI_Sendrecv(send.data(), nsend, MPI_DOUBLE, to, 1, recv.data(), nrecv, MPI_DOUBLE, from, 1,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+#endif
+}
+
+template <int D>
+void Domain<D>::migrate(Cells<D> &cell)
+// Drop the ghosts and hand every cell outside the slab to the process that now owns it. Cells
+// move less than rs-rn between refreshes, so they can only enter a neighboring slab.
+{
+    if(size == 1) return;
+
+    vector<int> keep, down, up;
+    keep.reserve(cell.N);
+
+    for(int i=0; i<cell.N; i++)
+    {
+        int l = layer(cell.x[D-1][i]);
+        if(l >= lo && l < hi) keep.push_back(i);
+        else if(owner(l) == below) down.push_back(i);
+        else if(owner(l) == above) up.push_back(i);
+        else
+        {
+            cout << "Cell " << cell.index[i] << " skipped a slab. Status 721\n";
+#ifdef USE_MPI
+            MPI_Abort(MPI_COMM_WORLD, 721);
+#endif
+        }
+    }
+
+    vector<double> fromAbove, fromBelow;
+    pack(cell, down, sendBuffer, true);
+    exchange(below, sendBuffer, above, fromAbove);
+    pack(cell, up, sendBuffer, true);
+    exchange(above, sendBuffer, below, fromBelow);
+
+    // The Verlet lists refer to ghosts and leaving cells, and are rebuilt after this anyway.
+
+    cell.verletStart.assign(cell.N+1, 0);
+    cell.verletList.clear();
+    cell.permute(keep);
+
+    int stride = 2+6*D;
+    int n = cell.N + (fromBelow.size() + fromAbove.size())/stride;
+    cell.resizeArrays(n);
+    unpack(cell, cell.N, fromBelow, true);
+    unpack(cell, cell.N + fromBelow.size()/stride, fromAbove, true);
+    cell.N = n;
+    cell.verletStart.assign(n+1, 0);
+}
+
+template <int D>
+void Domain<D>::exchangeGhosts(Cells<D> &cell)
+// Copy the cells of the two boundary layers to the neighboring processes. Must follow migrate.
+{
+    if(size == 1) return;
+
+    sendBelow.clear();
+    sendAbove.clear();
+    for(int i=0; i<cell.N; i++)
+    {
+        int l = layer(cell.x[D-1][i]);
+        if(l == lo)   sendBelow.push_back(i);
+        if(l == hi-1) sendAbove.push_back(i);
+    }
+
+    vector<double> fromAbove, fromBelow;
+    pack(cell, sendBelow, sendBuffer, false);
+    exchange(below, sendBuffer, above, fromAbove);
+    pack(cell, sendAbove, sendBuffer, false);
+    exchange(above, sendBuffer, below, fromBelow);
+
+    int stride = 2+2*D;
+    ghostsBelow = fromBelow.size()/stride;
+    ghostsAbove = fromAbove.size()/stride;
+
+    cell.resizeArrays(cell.N + ghostsBelow + ghostsAbove);
+    unpack(cell, cell.N, fromBelow, false);
+    unpack(cell, cell.N + ghostsBelow, fromAbove, false);
+    cell.nGhost = ghostsBelow + ghostsAbove;
+}
+
+template <int D>
+void Domain<D>::updateGhosts(Cells<D> &cell)
+// New positions and directions of the ghosts, once per step between refreshes.
+{
+    if(size == 1) return;
+#ifdef USE_MPI
+    for(int direction=0; direction<2; direction++)
+    {
+        vector<int> &list = (direction == 0) ? sendBelow : sendAbove;
+        int to    = (direction == 0) ? below : above;
+        int from  = (direction == 0) ? above : below;
+        int first = (direction == 0) ? cell.N + ghostsBelow : cell.N;
+        int nrecv = (direction == 0) ? ghostsAbove : ghostsBelow;
+
+        sendBuffer.resize(list.size()*2*D);
+        for(size_t n=0; n<list.size(); n++)
+        {
+            for(int k=0; k<D; k++)
+            {
+                sendBuffer[(n*D + k)*2]   = cell.x[k][list[n]];
+                sendBuffer[(n*D + k)*2+1] = cell.u[k][list[n]];
+            }
+        }
+
+        recvBuffer.resize(nrecv*2*D);
+        MPI_Sendrecv(sendBuffer.data(), sendBuffer.size(), MPI_DOUBLE, to, 2,
+                     recvBuffer.data(), recvBuffer.size(), MPI_DOUBLE, from, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        for(int n=0; n<nrecv; n++)
+        {
+            for(int k=0; k<D; k++)
+            {
+                cell.x[k][first+n] = recvBuffer[(n*D + k)*2];
+                cell.u[k][first+n] = recvBuffer[(n*D + k)*2+1];
+            }
+        }
+    }
+#endif
+}
+
+template <int D>
+void Domain<D>::gather(Cells<D> &cell, Cells<D> &all)
+// Collect positions, velocities and directions of all cells on process 0, in their original
+// order, for the measurements that need every pair of cells.
+{
+#ifdef USE_MPI
+    int stride = 2+3*D;
+    sendBuffer.clear();
+    for(int i=0; i<cell.N; i++)
+    {
+        sendBuffer.push_back(cell.index[i]);
+        sendBuffer.push_back(cell.R[i]);
+        for(int k=0; k<D; k++)
+        {
+            sendBuffer.push_back(cell.x[k][i]);
+            sendBuffer.push_back(cell.v[k][i]);
+            sendBuffer.push_back(cell.u[k][i]);
+        }
+    }
+
+    int nsend = sendBuffer.size();
+    vector<int> counts(size), displs(size, 0);
+    MPI_Gather(&nsend, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    for(int r=1; r<size; r++) displs[r] = displs[r-1] + counts[r-1];
+    if(rank == 0) recvBuffer.resize(displs[size-1] + counts[size-1]);
+
+    MPI_Gatherv(sendBuffer.data(), nsend, MPI_DOUBLE, recvBuffer.data(), counts.data(), displs.data(),
+                MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if(rank != 0) return;
+
+    int n = recvBuffer.size()/stride;
+    all.resize(n, cell.dt);
+    all.L = cell.L;
+    all.Lover2 = cell.Lover2;
+
+    for(int m=0; m<n; m++)
+    {
+        double *c = &recvBuffer[m*stride];
+        int i = (int)c[0];
+        all.R[i] = c[1];
+        all.Rinv[i] = 1.0/c[1];
+        c += 2;
+        for(int k=0; k<D; k++)
+        {
+            all.x[k][i] = *c++;
+            all.v[k][i] = *c++;
+            all.u[k][i] = *c++;
+        }
+    }
+#endif
+}
+
+template <int D>
+void Domain<D>::largestTwo(double &largest, double &second)
+// The two largest of all processes' two largest values.
+{
+    if(size == 1) return;
+#ifdef USE_MPI
+    double mine[2] = {largest, second};
+    vector<double> values(2*size);
+    MPI_Allgather(mine, 2, MPI_DOUBLE, values.data(), 2, MPI_DOUBLE, MPI_COMM_WORLD);
+
+    largest = second = 0.0;
+    for(int m=0; m<2*size; m++)
+    {
+        if(values[m] > largest)     { second = largest; largest = values[m]; }
+        else if(values[m] > second) { second = values[m]; }
+    }
+#endif
+}
+
+template <int D>
+void Domain<D>::broadcast(uint64_t &value)
+// Process 0's value on every process
+{
+#ifdef USE_MPI
+    MPI_Bcast(&value, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+#endif
+}
@@ -0,0 +1,113 @@
+
+// *** Fast Fourier transforms on a periodic mesh ***
+
+// A complex transform of an M^D mesh stored with the first index running fastest, done as
+// one-dimensional radix-2 transforms along each axis in turn, so M must be a power of two.
+// Neither direction is normalised: a forward and an inverse transform multiply by M^D.
+//
+// Along the first axis a line is contiguous. Along the others, the lines that start at
+// neighbouring points are neighbours in memory, so they are copied out and transformed a block
+// at a time, which keeps the strided reads to whole cache lines.
+
+#include <complex>
+
+struct FFT
+{
+    FFT(int, int);
+
+    void transform(vector<complex<double>>&, bool);
+
+    int M, D;
+    long int size;                      // M^D
+
+private:
+    static const int blockLines = 16;   // Lines transformed together along the strided axes
+
+    vector<complex<double>> twiddle;    // exp(-2 pi i m/M) for m < M/2
+    vector<int> reversed;               // Bit-reversed order of 0..M-1
+    vector<complex<double>> buffer;
+
+    void transformLines(complex<double>*, int, bool);
+};
+
+FFT::FFT(int M_, int D_)
+{
+    M = M_;
+    D = D_;
+    size = 1;
+    for(int d=0; d<D; d++) size *= M;
+
+    twiddle.resize(M/2);
+    for(int m=0; m<M/2; m++) twiddle[m] = polar(1.0, -2.0*M_PI*m/M);
+
+    int bits = 0;
+    while((1 << bits) < M) bits++;
+    reversed.resize(M);
+    for(int m=0; m<M; m++)
+    {
+        int r = 0;
+        for(int b=0; b<bits; b++) if(m & (1 << b)) r |= 1 << (bits-1-b);
+        reversed[m] = r;
+    }
+    buffer.resize(M*blockLines);
+}
+
+void FFT::transformLines(complex<double> *a, int block, bool inverse)
+// Transform block lines at once, point m of line b at a[m*block+b]
+{
+    for(int m=0; m<M; m++)
+    {
+        if(m < reversed[m]) for(int b=0; b<block; b++) swap(a[m*block+b], a[reversed[m]*block+b]);
+    }
+
+    for(int half=1; half<M; half*=2)
+    {
+        int step = M/(2*half);
+        for(int start=0; start<M; start+=2*half)
+        {
+            for(int m=0; m<half; m++)
+            {
+                // The product is written out, which spares the checks for infinities that the
+                // complex operator does.
+
+                double wr = twiddle[m*step].real();
+                double wi = inverse ? -twiddle[m*step].imag() : twiddle[m*step].imag();
+                complex<double> *even = a + (start+m)*block;
+                complex<double> *odd = a + (start+m+half)*block;
+
+                for(int b=0; b<block; b++)
+                {
+                    double xr = odd[b].real(), xi = odd[b].imag();
+                    double tr = wr*xr - wi*xi;
+                    double ti = wr*xi + wi*xr;
+                    double er = even[b].real(), ei = even[b].imag();
+                    odd[b] = complex<double>(er - tr, ei - ti);
+                    even[b] = complex<double>(er + tr, ei + ti);
+                }
+            }
+        }
+    }
+}
+
+void FFT::transform(vector<complex<double>> &mesh, bool inverse)
+// In place, forward or inverse
+{
+    long int stride = 1;
+    for(int d=0; d<D; d++)
+    {
+        int block = (int)min((long int)blockLines, stride);
+
+        for(long int outer=0; outer<size; outer+=stride*M)
+        {
+            for(long int inner=0; inner<stride; inner+=block)
+            {
+                complex<double> *start = mesh.data() + outer + inner;
+
+                for(int m=0; m<M; m++) for(int b=0; b<block; b++) buffer[m*block+b] = start[m*stride+b];
+                transformLines(buffer.data(), block, inverse);
+                for(int m=0; m<M; m++) for(int b=0; b<block; b++) start[m*stride+b] = buffer[m*block+b];
+            }
+        }
+        stride *= M;
+    }
+}
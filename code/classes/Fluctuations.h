@@ -3,17 +3,23 @@
 // **** Methods for calculating density fluctuations                            ***
 // ********************************************************************************
 
-// *** Gets NDIM from definition in main ***
+// *** Templated on the number of dimensions D ***
 
+template <int D>
 struct Fluctuations
 {
     Fluctuations(double, int, int, double);
     
     double overlap(double, double, double);
-    void measureFluctuations(vector<Cell>&, vector<double>&, Print&);
+    void measureFluctuations(Cells<D>&, std::array<double, D>&, Print<D>&);
+    void setupGrid(int, double);
+    void measureGrid(Cells<D>&, Random&, long int);
+    void print_grid(Print<D>&);
     double delta_norm(double);
-    void density_distribution(vector<Cell>&, vector<Box>&);
-    void print_density_distribution(int, Print&);
+    void density_distribution(CellList&, int);
+    void print_density_distribution(int, Print<D>&);
+    void save(Checkpoint&);
+    void load(Checkpoint&);
     
     vector<double> distribution;
     
@@ -28,9 +34,32 @@ struct Fluctuations
     double dens;
     
     double Lover2, L;
+    
+    // Measurements at many radii around many random centres at once, with "--fluctuations grid".
+    // The cells are binned into the box grid of the engine, with b boxes of side lp per dimension.
+    // Boxes entirely inside or outside a sphere add their volume or nothing, and only the cells
+    // of the boxes on its surface need the overlap.
+    
+    bool grid;
+    int threads;                        // OpenMP threads, over the centres
+    int gridRadii;                      // Radii per centre
+    int gridCentres;                    // Centres per sample
+    vector<double> radii;
+    vector<double> gridSums;            // Sums of (V - expected V)^2 at each radius
+    long int gridSamples;               // Volumes in each sum
+    
+private:
+    int b, nbox;
+    double lp;
+    ivec box;
+    CellList boxCells;
+    vector<double> boxVolume;           // Volume of the cells in each box
+    vector<double> cellVolume;
+    vector<double> volumes;             // V at each radius around each centre
 };
 
-Fluctuations::Fluctuations(double L_, int totalSteps, int skip, double dens_)
+template <int D>
+Fluctuations<D>::Fluctuations(double L_, int totalSteps, int skip, double dens_)
 {
     L = L_;
     Lover2 = L/2.0;
@@ -46,33 +75,44 @@ Fluctuations::Fluctuations(double L_, int totalSteps, int skip, double dens_)
     current_value = 0;
     
     distribution.assign(50,0.0);
+    
+    grid = false;
+    threads = 1;
+    gridRadii = 32;
+    gridCentres = 64;
+    gridSamples = 0;
+    b = 0;
+    nbox = 0;
+    lp = 0.0;
 };
 
-void Fluctuations::measureFluctuations(vector<Cell> &cell, vector<double> &COM, Print &print)
+template <int D>
+void Fluctuations<D>::measureFluctuations(Cells<D> &cell, std::array<double, D> &COM, Print<D> &print)
 // Draw a measurement circle around the center of mass and calculate total intersecting volume
 // Calculate fluctuation from the expected intersecting volume
 {
     double expectedV = 0.0;
-    if (NDIM == 2) expectedV = dens*PI*current_radius*current_radius;
-    if (NDIM == 3) expectedV = 4.0*dens*PI*current_radius*current_radius*current_radius/3.0;
-    int N = cell.size();
+    if constexpr (D==2) expectedV = dens*PI*current_radius*current_radius;
+    if constexpr (D==3) expectedV = 4.0*dens*PI*current_radius*current_radius*current_radius/3.0;
+    int N = cell.N;
     
     if(counter < time_interval) {
         double V = 0.0;
         for (int i=0; i<N; i++)
         {
-            double sumR = cell[i].R+current_radius;
+            double sumR = cell.R[i]+current_radius;
             double d2 = 0.0;
-            for (int k=0; k<NDIM; k++) {
-                double dr = delta_norm(cell[i].x_real[k]-COM[k]);
+            for (int k=0; k<D; k++) {
+                double dr = delta_norm(cell.x_real[k][i]-COM[k]);
                 d2 += dr*dr;
             }
             
             if( d2 <= sumR*sumR )
             {   // If the circles have a nonzero overlap
-                V += overlap(cell[i].R, current_radius, sqrt(d2));
+                V += overlap(cell.R[i], current_radius, sqrt(d2));
             }
         }
+        V = globalSum(V);
         current_value+=(V-expectedV)*(V-expectedV);
     }
     else
@@ -86,17 +126,177 @@ void Fluctuations::measureFluctuations(vector<Cell> &cell, vector<double> &COM,
     counter++;
 }
 
-double Fluctuations::overlap(double r, double R, double d)
+template <int D>
+void Fluctuations<D>::setupGrid(int b_, double lp_)
+// Radii from min_radius to just below max_radius, evenly spaced in log
+{
+    grid = true;
+    b = b_;
+    lp = lp_;
+    nbox = 1;
+    for(int k=0; k<D; k++) nbox *= b;
+    
+    radii.resize(gridRadii);
+    for(int j=0; j<gridRadii; j++) radii[j] = min_radius*pow(max_radius/min_radius, (double)j/gridRadii);
+    gridSums.assign(gridRadii, 0.0);
+    gridSamples = 0;
+}
+
+template <int D>
+void Fluctuations<D>::measureGrid(Cells<D> &cell, Random &rng, long int t)
+// The centres are drawn from the step, so all processes use the same ones, each summing the
+// volume of its own cells.
+{
+    int N = cell.N;
+    box.resize(N);
+    cellVolume.resize(N);
+    boxVolume.assign(nbox, 0.0);
+    double rmax = 0.0;
+    
+    for(int i=0; i<N; i++)
+    {
+        int p = 0;
+        int stride = 1;
+        for(int k=0; k<D; k++)
+        {
+            int c = (int)((cell.x[k][i] + Lover2)/lp);
+            if(c >= b)     c = b-1;
+            else if(c < 0) c = 0;
+            p += c*stride;
+            stride *= b;
+        }
+        box[i] = p;
+        if constexpr (D==2) cellVolume[i] = PI*cell.R[i]*cell.R[i];
+        if constexpr (D==3) cellVolume[i] = 4.0*PI*cell.R[i]*cell.R[i]*cell.R[i]/3.0;
+        boxVolume[p] += cellVolume[i];
+        rmax = max(rmax, cell.R[i]);
+    }
+    boxCells.sort(box, nbox);
+    
+    volumes.assign(gridCentres*gridRadii, 0.0);
+    
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for(int c=0; c<gridCentres; c++)
+    {
+        double centre[D];
+        double u[4];
+        rng.uniforms(Random::centre, 2*c, t, u[0], u[1]);
+        rng.uniforms(Random::centre, 2*c+1, t, u[2], u[3]);
+        for(int k=0; k<D; k++) centre[k] = -Lover2 + L*u[k];
+        
+        double *V = &volumes[c*gridRadii];
+        vector<double> inside(gridRadii+1, 0.0);    // Volume of the cells inside from each radius on
+        
+        // Nearest and farthest distance from the centre along each axis, for each row of boxes
+        
+        vector<double> near(D*b), far(D*b);
+        for(int k=0; k<D; k++)
+        {
+            for(int m=0; m<b; m++)
+            {
+                double d = fabs(delta_norm(-Lover2 + (m + 0.5)*lp - centre[k]));
+                near[k*b+m] = max(d - lp/2.0, 0.0)*max(d - lp/2.0, 0.0);
+                far[k*b+m] = min(d + lp/2.0, Lover2)*min(d + lp/2.0, Lover2);
+            }
+        }
+        
+        for(int p=0; p<nbox; p++)
+        {
+            if(boxCells.size(p) == 0) continue;
+            
+            double near2 = 0.0, far2 = 0.0;
+            int q = p;
+            for(int k=0; k<D; k++)
+            {
+                near2 += near[k*b + q%b];
+                far2 += far[k*b + q%b];
+                q /= b;
+            }
+            
+            // No cell of the box reaches spheres below radius jLow, and all are inside from jIn on
+            
+            int jLow = upper_bound(radii.begin(), radii.end(), sqrt(near2) - rmax) - radii.begin();
+            int jIn = lower_bound(radii.begin(), radii.end(), sqrt(far2) + rmax) - radii.begin();
+            if(jLow == jIn)
+            {
+                inside[jIn] += boxVolume[p];
+                continue;
+            }
+            
+            // The same for each cell of a box on the surface of some of the spheres. Only the
+            // spheres that cut through the cell need the overlap.
+            
+            int *list = boxCells.cells(p);
+            for(int m=0; m<boxCells.size(p); m++)
+            {
+                int i = list[m];
+                double d2 = 0.0;
+                for(int k=0; k<D; k++)
+                {
+                    double dr = delta_norm(cell.x[k][i] - centre[k]);
+                    d2 += dr*dr;
+                }
+                double d = sqrt(d2);
+                
+                int jCut = upper_bound(radii.begin()+jLow, radii.begin()+jIn, d - cell.R[i]) - radii.begin();
+                int jFull = lower_bound(radii.begin()+jCut, radii.begin()+jIn, d + cell.R[i]) - radii.begin();
+                for(int j=jCut; j<jFull; j++) V[j] += overlap(cell.R[i], radii[j], d);
+                inside[jFull] += cellVolume[i];
+            }
+        }
+        
+        double sum = 0.0;
+        for(int j=0; j<gridRadii; j++)
+        {
+            sum += inside[j];
+            V[j] += sum;
+        }
+    }
+    
+    globalSum(volumes.data(), gridCentres*gridRadii);
+    
+    for(int j=0; j<gridRadii; j++)
+    {
+        double expectedV = 0.0;
+        if constexpr (D==2) expectedV = dens*PI*radii[j]*radii[j];
+        if constexpr (D==3) expectedV = 4.0*dens*PI*radii[j]*radii[j]*radii[j]/3.0;
+        
+        for(int c=0; c<gridCentres; c++)
+        {
+            double dV = volumes[c*gridRadii+j] - expectedV;
+            gridSums[j] += dV*dV;
+        }
+    }
+    gridSamples += gridCentres;
+}
+
+template <int D>
+void Fluctuations<D>::print_grid(Print<D> &print)
+// At the end of the run, in the format of the measurement around the center of mass
+{
+    if(!grid || gridSamples == 0) return;
+    
+    for(int j=0; j<gridRadii; j++)
+    {
+        double expectedV = 0.0;
+        if constexpr (D==2) expectedV = dens*PI*radii[j]*radii[j];
+        if constexpr (D==3) expectedV = 4.0*dens*PI*radii[j]*radii[j]*radii[j]/3.0;
+        print.print_fluct(radii[j], expectedV, sqrt(gridSums[j]/gridSamples));
+    }
+}
+
+template <int D>
+double Fluctuations<D>::overlap(double r, double R, double d)
 {
     if (R>=r+d)
     {   // If cell lies completely in measurement circle
-        if(NDIM == 2) return PI*r*r;
-        if(NDIM == 3) return 4.0*PI*r*r*r/3.0;
+        if constexpr (D==2) return PI*r*r;
+        if constexpr (D==3) return 4.0*PI*r*r*r/3.0;
     }
     
     else
     {   // If there is a partial intersection
-        if(NDIM == 2)
+        if constexpr (D==2)
         {
             double R12 = r*r;
             double R22 = R*R;
@@ -110,7 +310,7 @@ double Fluctuations::overlap(double r, double R, double d)
             return A;
         }
         
-        if(NDIM == 3)
+        if constexpr (D==3)
         {
             double x2 = (r+R-d)*(r+R-d)/(12.0*d);
             double y2 = d*d + 2.0*d*r - 3.0*r*r + 2.0*d*R + 6*r*R - 3*R*R;
@@ -119,16 +319,16 @@ double Fluctuations::overlap(double r, double R, double d)
     }
 }
 
-void Fluctuations::density_distribution( vector<Cell> &cell, vector<Box> &grid )
+template <int D>
+void Fluctuations<D>::density_distribution( CellList &boxCells, int size )
 // Count cell centers in each spatial partition and plot the frequencies of densities in a histogram
 {
-    int size = grid.size();
     int delta = 1;
     
     vector<double> counts(size,0.0);
     
     for (int j=0; j<size; j++) {
-        double count = grid[j].CellList.size();
+        double count = boxCells.size(j);
         counts[j] = count;
     }
     
@@ -138,13 +338,15 @@ void Fluctuations::density_distribution( vector<Cell> &cell, vector<Box> &grid )
     }
 }
 
-void Fluctuations::print_density_distribution(int timeAvg, Print &print)
+template <int D>
+void Fluctuations<D>::print_density_distribution(int timeAvg, Print<D> &print)
 {
     for(int k=0; k<distribution.size(); k++)
         print.print_dens(k, distribution[k]/timeAvg);
 }
 
-double Fluctuations::delta_norm(double delta)
+template <int D>
+double Fluctuations<D>::delta_norm(double delta)
 // Subtracts multiples of the box size to account for periodic boundary conditions
 {
     int k=-1;
@@ -153,3 +355,26 @@ double Fluctuations::delta_norm(double delta)
     
     return delta;
 }
+
+template <int D>
+void Fluctuations<D>::save(Checkpoint &file)
+// The measurement in progress and the density histogram
+{
+    file.put(current_radius);
+    file.put(counter);
+    file.put(current_value);
+    file.put(distribution);
+    file.put(gridSums);
+    file.put(gridSamples);
+}
+
+template <int D>
+void Fluctuations<D>::load(Checkpoint &file)
+{
+    file.get(current_radius);
+    file.get(counter);
+    file.get(current_value);
+    file.get(distribution);
+    file.get(gridSums);
+    file.get(gridSamples);
+}
@@ -0,0 +1,167 @@
+
+// *** Multi-tau correlator ***
+
+// Correlates a signal with itself at lags from 0 up to the whole run, over every time origin,
+// while keeping only a few samples per level. Level 0 holds the last `points` samples and gives
+// lags 0 to points-1. Every `factor` samples of a level are averaged into one sample of the next
+// level, whose lags are points/factor to points-1 of its own, coarser, samples. So level l covers
+// lags up to (points-1)*factor^l, and the memory grows with the logarithm of the run length.
+// Levels are added as they are first needed.
+//
+// A sample is a vector of `width` values, and the correlation is the dot product of two samples,
+// summed over all its values.
+
+struct MultiTau
+{
+    MultiTau();
+
+    void setup(long int, int, int);
+    void add(const double*);
+    void results(vector<long int>&, vector<double>&);
+    void save(Checkpoint&);
+    void load(Checkpoint&);
+
+    long int width;                     // Values per sample
+    int points;                         // Samples kept per level
+    int factor;                         // Samples of a level averaged into one of the next
+
+private:
+    struct Level
+    {
+        vector<double> samples;         // The last points samples, as a ring
+        int newest;                     // Slot of the last sample
+        int filled;                     // Slots in use
+        vector<double> block;           // Sum of the samples to be passed on to the next level
+        int blockCount;
+        vector<double> sums;            // Sums of the products at each lag
+        vector<long int> counts;
+    };
+    vector<Level> levels;
+
+    void add(int, const double*);
+    void addLevel();
+};
+
+MultiTau::MultiTau()
+{
+    width = 0;
+    points = 16;
+    factor = 2;
+}
+
+void MultiTau::setup(long int width_, int points_, int factor_)
+{
+    width = width_;
+    points = points_;
+    factor = factor_;
+    levels.clear();
+    levels.reserve(64);                 // More than any run needs, so that levels never move
+}
+
+void MultiTau::addLevel()
+{
+    Level level;
+    level.samples.assign(points*width, 0.0);
+    level.newest = points-1;
+    level.filled = 0;
+    level.block.assign(width, 0.0);
+    level.blockCount = 0;
+    level.sums.assign(points, 0.0);
+    level.counts.assign(points, 0);
+    levels.push_back(level);
+}
+
+void MultiTau::add(const double *sample)
+// The next sample
+{
+    add(0, sample);
+}
+
+void MultiTau::add(int l, const double *sample)
+{
+    if(l == (int)levels.size()) addLevel();
+    Level &level = levels[l];
+
+    level.newest = (level.newest+1)%points;
+    double *slot = level.samples.data() + (long int)level.newest*width;
+    for(long int w=0; w<width; w++) slot[w] = sample[w];
+    level.filled = min(level.filled+1, points);
+
+    // Lags below points/factor on a coarse level are covered more finely by the level below.
+
+    for(int j=(l == 0 ? 0 : points/factor); j<level.filled; j++)
+    {
+        const double *earlier = level.samples.data() + (long int)((level.newest-j+points)%points)*width;
+        double product = 0.0;
+        for(long int w=0; w<width; w++) product += sample[w]*earlier[w];
+        level.sums[j] += product;
+        level.counts[j]++;
+    }
+
+    for(long int w=0; w<width; w++) level.block[w] += sample[w];
+    if(++level.blockCount == factor)
+    {
+        for(long int w=0; w<width; w++) level.block[w] /= factor;
+        add(l+1, level.block.data());
+        level.block.assign(width, 0.0);
+        level.blockCount = 0;
+    }
+}
+
+void MultiTau::results(vector<long int> &lag, vector<double> &value)
+// Mean product of samples at each lag, in samples, for the lags seen so far
+{
+    lag.clear();
+    value.clear();
+
+    long int scale = 1;
+    for(size_t l=0; l<levels.size(); l++, scale*=factor)
+    {
+        for(int j=(l == 0 ? 0 : points/factor); j<points; j++)
+        {
+            if(levels[l].counts[j] == 0) continue;
+            lag.push_back(j*scale);
+            value.push_back(levels[l].sums[j]/levels[l].counts[j]);
+        }
+    }
+}
+
+void MultiTau::save(Checkpoint &file)
+{
+    file.put(width);
+    file.put(points);
+    file.put(factor);
+    uint64_t n = levels.size();
+    file.put(n);
+    for(Level &level : levels)
+    {
+        file.put(level.samples);
+        file.put(level.newest);
+        file.put(level.filled);
+        file.put(level.block);
+        file.put(level.blockCount);
+        file.put(level.sums);
+        file.put(level.counts);
+    }
+}
+
+void MultiTau::load(Checkpoint &file)
+{
+    file.get(width);
+    file.get(points);
+    file.get(factor);
+    uint64_t n = 0;
+    file.get(n);
+    levels.reserve(64);
+    levels.resize(n);
+    for(Level &level : levels)
+    {
+        file.get(level.samples);
+        file.get(level.newest);
+        file.get(level.filled);
+        file.get(level.block);
+        file.get(level.blockCount);
+        file.get(level.sums);
+        file.get(level.counts);
+    }
+}
@@ -0,0 +1,84 @@
+
+// *** Observables of the whole system from one pass over the cells ***
+
+// The order parameter and the mean direction of motion are the same sum of normalised
+// velocities, and the mean squared displacement needs the same walk over the cells. One sweep
+// adds up all of them, and one global sum combines the processes of a decomposed run. The
+// results are kept with the step they belong to, so that printing, the Binder averages and the
+// autocorrelation all use them without walking the cells again. The center of mass is already
+// found by the update of the positions and is passed in.
+
+template <int D>
+struct Observables
+{
+    Observables();
+
+    void measure(Cells<D>&, long int, long int, std::array<double, D>&, std::array<double, D>&, bool, int);
+    bool current(long int, bool);
+
+    long int step;                      // Step of the last measurement, -1 before the first
+    bool hasMSD;                        // The last measurement included the MSD
+
+    std::array<double, D> orientation;  // Mean direction of motion
+    double order;                       // Length of the mean direction, the order parameter
+    double MSD;                         // Mean squared displacement relative to the center of mass
+};
+
+template <int D>
+Observables<D>::Observables()
+{
+    step = -1;
+    hasMSD = false;
+    orientation.fill(0.0);
+    order = 0.0;
+    MSD = 0.0;
+}
+
+template <int D>
+bool Observables<D>::current(long int t, bool msd)
+// True if the values for step t, with the MSD if asked for, are already there.
+{
+    return step == t && (hasMSD || !msd);
+}
+
+template <int D>
+void Observables<D>::measure(Cells<D> &cell, long int t, long int N, std::array<double, D> &COM,
+                             std::array<double, D> &COM0, bool msd, int threads)
+// Measure at step t. N is the number of cells of all processes together. The MSD is only
+// calculated when msd is set.
+{
+    double sum[D+1];
+    for(int k=0; k<=D; k++) sum[k] = 0.0;
+
+    #pragma omp parallel for schedule(static) num_threads(threads) reduction(+:sum[:D+1])
+    for(int i=0; i<cell.N; i++)
+    {
+        double v2 = 0.0;
+        for(int k=0; k<D; k++) v2 += cell.v[k][i]*cell.v[k][i];
+        double inverseVel = 1.0/sqrt(v2);
+        for(int k=0; k<D; k++) sum[k] += cell.v[k][i]*inverseVel;
+
+        if(msd)
+        {
+            double d2 = 0.0;
+            for(int k=0; k<D; k++)
+            {
+                double dk = cell.x_real[k][i] - cell.x0[k][i] - COM[k] + COM0[k];
+                d2 += dk*dk;
+            }
+            sum[D] += d2;
+        }
+    }
+
+    globalSum(sum, D+1);
+
+    double order2 = 0.0;
+    for(int k=0; k<D; k++) order2 += sum[k]*sum[k];
+
+    order = sqrt(order2)/(double)N;
+    for(int k=0; k<D; k++) orientation[k] = sum[k]/(double)N;
+    MSD = msd ? sum[D]/N : 0.0;
+
+    step = t;
+    hasMSD = msd;
+}
@@ -7,46 +7,77 @@
 #include <fstream>
 #include <string>
 #include <iomanip>
+#include <cstdint>
 #include <sys/types.h>
 #include <dirent.h>
+#include <unistd.h>
 
+template <int D>
 struct Print
 {
-    Print(string, string, string, int, bool);
+    Print(string, string, string, int, bool, bool, bool);
     ~Print();
     
-    void print_COM(long int, vector<double>&);
-    void print_orientation(long int, vector<double>&);
+    void startColumns(string, long int, long int, bool);
+    vector<long int> sizes();
+    void resume(vector<long int>&);
+    
+    void print_COM(long int, std::array<double, D>&);
+    void print_orientation(long int, std::array<double, D>&);
     void print_order(long int, double);
     void print_velDist(double, double);
     void print_corr(double,double);
     void print_orientationCorr(double,double);
     void print_dens(double,double);
     void print_pairCorr(double,double);
+    void print_structureFactor(double,double);
     void print_autoCorr(int, double);
+    void print_autoCorrMultiTau(long int, double);
+    void print_vaf(long int, double);
+    void print_MSDAveraged(long int, double);
     void print_MSD(int, double);
     void print_fluct(double, double, double);
-    void print_Ovito(int&, int&, int&, double&, int&, vector<double>&, vector<double>&);
-    void print_summary(string, int, double, long int, int, double, double, double, double, long int, double, double, double);
+    void print_frame(long int, double, vector<double>&, vector<vector<double>>&, vector<vector<double>>&, vector<int>&);
+    void print_summary(string, int, double, long int, int, double, double, double, double, long int, double, double, double, uint64_t,
+                       double, bool, double, double, double, double);
     
     ofstream COM, orientation, order,
-             corr, orientationCorr, pairCorr, autoCorr,
+             corr, orientationCorr, pairCorr, structureFactor, autoCorr, autoCorrMultiTau, vaf, MSDAveraged,
              velDist, MSD, fluct, dens,
-             OvitoVid, summary, summary2;
+             summary, summary2;
+    TrajectoryWriter video;
+    Writer writer;                      // Writes COM, orientation, order, fluct and MSD off the simulation thread
+    Columns columns;                    // COM, orientation, order and MSD in binary, with "--series binary"
 
     string run;
     string path;
+    
+private:
+    bool output;
+    vector<pair<ofstream*, string>> series();
+    
+    enum { fileCOM, fileOrientation, fileOrder, fileMSD, fileFluct };
+    void write(OutputRecord&);
+    void flushWritten();
 };
 
-Print::Print(string location, string fullRun, string ID, int noCells, bool remote){
+template <int D>
+Print<D>::Print(string location, string fullRun, string ID, int noCells, bool remote, bool output_, bool restart){
 
     run = ID;
+    output = output_;
+    
     string loc;
 	
     if(remote == 0) loc = location+"local_output/";
     if(remote == 1)	loc = location+"remote_output/";
 	
     path = loc+fullRun+"/";
+    
+    // Only one process of a domain-decomposed run writes. The others keep their files closed,
+    // and whatever they print is dropped.
+    
+    if(!output) return;
 		
     int check = 0;
     const char *p = path.c_str();
@@ -76,113 +107,286 @@ Print::Print(string location, string fullRun, string ID, int noCells, bool remot
         exit(716);
     }
     
-    COM.open((path+run+"/dat/COM.dat").c_str());
-    orientation.open((path+run+"/dat/orientation.dat").c_str());
-    order.open((path+run+"/dat/order.dat").c_str());
+    // The time series are written during the run. A restarted run keeps them, and resume cuts
+    // them back to where the checkpoint was taken.
+    
+    for(auto &file : series())
+    {
+        if(restart) file.first->open((path+run+file.second).c_str(), ios::app);
+        else        file.first->open((path+run+file.second).c_str());
+    }
+    
     corr.open((path+run+"/dat/corr.dat").c_str());
     orientationCorr.open((path+run+"/dat/orientationCorr.dat").c_str());
     pairCorr.open((path+run+"/dat/pairCorr.dat").c_str());
     velDist.open((path+run+"/dat/velDist.dat").c_str());
     autoCorr.open((path+run+"/dat/autoCorr.dat").c_str());
-    fluct.open((path+run+"/dat/fluct.dat").c_str());
     dens.open((path+run+"/dat/densDist.dat").c_str());
-    MSD.open((path+run+"/dat/MSD.dat").c_str());
-    OvitoVid.open((path+run+"/vid/ovito.txt").c_str());
     summary.open((path+run+"/dat/summary.dat").c_str());
     summary2.open((path+run+"/dat/summary2.dat").c_str());
+    
+    writer.start([this](OutputRecord &record){ write(record); }, [this]{ flushWritten(); });
 }
 
-Print::~Print(){
+template <int D>
+Print<D>::~Print(){
+    writer.finish();
     COM.close();
     orientation.close();
     order.close();
     corr.close();
     orientationCorr.close();
     pairCorr.close();
+    structureFactor.close();
     autoCorr.close();
+    autoCorrMultiTau.close();
+    vaf.close();
+    MSDAveraged.close();
     velDist.close();
     fluct.close();
     dens.close();
     MSD.close();
-    OvitoVid.close();
+    video.frames.close();
+    video.index.close();
     summary.close();
     summary2.close();
 }
 
-void Print::print_COM(long int t, vector<double> &center)
+template <int D>
+vector<pair<ofstream*, string>> Print<D>::series()
+// Files that grow during the run, with their place in the run's folder
 {
-    if(NDIM == 2) COM << t << "\t" << center[0] << "\t" << center[1] << endl;
-    if(NDIM == 3) COM << t << "\t" << center[0] << "\t" << center[1] << "\t" << center[2] << endl;
+    return { {&COM, "/dat/COM.dat"}, {&orientation, "/dat/orientation.dat"}, {&order, "/dat/order.dat"},
+             {&fluct, "/dat/fluct.dat"}, {&MSD, "/dat/MSD.dat"},
+             {&video.frames, "/vid/trajectory.bin"}, {&video.index, "/vid/trajectory.idx"} };
 }
 
-void Print::print_orientation(long int t, vector<double> &orient)
+template <int D>
+void Print<D>::startColumns(string parameters, long int rows, long int stride, bool restart)
+// Write COM, orientation, order and MSD to dat/series.bin from now on. A restarted run writes into
+// the file of the first one.
 {
-    if(NDIM==2) orientation << t << "\t" << orient[0] << "\t" << orient[1] << endl;
-    if(NDIM==3) orientation << t << "\t" << orient[0] << "\t" << orient[1] << "\t" << orient[2] << endl;
+    if(!output) return;
+    
+    const char axis[3] = {'x', 'y', 'z'};
+    vector<string> names;
+    for(int k=0; k<D; k++) names.push_back(string("COM_")+axis[k]);
+    for(int k=0; k<D; k++) names.push_back(string("orientation_")+axis[k]);
+    names.push_back("order");
+    names.push_back("MSD");
+    
+    string name = path+run+"/dat/series.bin";
+    if(restart) columns.open(name, rows, stride, names);
+    else        columns.create(name, parameters, rows, stride, names);
 }
 
-void Print::print_order(long int t, double o)
+template <int D>
+vector<long int> Print<D>::sizes()
+// Flush the time series and return their lengths in bytes, for a checkpoint.
 {
-    order << t << "\t" << o << endl;
+    vector<long int> length;
+    if(!output) return length;
+    
+    writer.drain();
+    for(auto &file : series())
+    {
+        file.first->flush();
+        length.push_back((long int)file.first->tellp());
+    }
+    return length;
 }
 
-void Print::print_Ovito(int &k, int &noCells, int &cellIndex, double &radius, int &overlap,
-                        vector<double> &x, vector<double> &v){
-// Print in "XYZ" file format, to be read by molecular dynamics visualization software
+template <int D>
+void Print<D>::resume(vector<long int> &length)
+// Cut the time series back to the lengths stored in a checkpoint. Lines written after it was
+// taken are written again by the restarted run.
+{
+    if(!output) return;
     
-    if(k==0){
-    // Demarcate the beginning of each time step
-        OvitoVid << noCells << endl;
-        OvitoVid << "time step comment" << endl;
+    writer.drain();
+    vector<pair<ofstream*, string>> files = series();
+    for(size_t m=0; m<files.size() && m<length.size(); m++)
+    {
+        string name = path+run+files[m].second;
+        files[m].first->close();
+        if(truncate(name.c_str(), length[m]) != 0)
+        {
+            cout << "Cannot restore " << name << " from the checkpoint. Status 733\n";
+            exit(733);
+        }
+        files[m].first->open(name.c_str(), ios::app);
     }
     
-    if(NDIM==2) {
-        OvitoVid << cellIndex << "\t" << radius << "\t" << overlap << "\t" << x[0] << "\t"
-                 << x[1] << "\t" << v[0] << "\t" << v[1] << endl;
+    long int frameBytes = 0, indexBytes = 0;
+    for(size_t m=0; m<files.size() && m<length.size(); m++)
+    {
+        if(files[m].first == &video.frames) frameBytes = length[m];
+        if(files[m].first == &video.index)  indexBytes = length[m];
+    }
+    video.resume(frameBytes, indexBytes);
+}
+
+template <int D>
+void Print<D>::print_COM(long int t, std::array<double, D> &center)
+{
+    OutputRecord record = {fileCOM, t, {0.0, 0.0, 0.0}};
+    for(int k=0; k<D; k++) record.value[k] = center[k];
+    writer.push(record);
+}
+
+template <int D>
+void Print<D>::print_orientation(long int t, std::array<double, D> &orient)
+{
+    OutputRecord record = {fileOrientation, t, {0.0, 0.0, 0.0}};
+    for(int k=0; k<D; k++) record.value[k] = orient[k];
+    writer.push(record);
+}
+
+template <int D>
+void Print<D>::print_order(long int t, double o)
+{
+    OutputRecord record = {fileOrder, t, {o, 0.0, 0.0}};
+    writer.push(record);
+}
+
+template <int D>
+void Print<D>::write(OutputRecord &r)
+// Runs on the writer thread
+{
+    double *v = r.value;
+    if(columns.active && r.file != fileFluct)
+    {
+        // Columns: COM, orientation, order, MSD
+        
+        if(r.file == fileCOM)         for(int k=0; k<D; k++) columns.set(k, r.t, v[k]);
+        if(r.file == fileOrientation) for(int k=0; k<D; k++) columns.set(D+k, r.t, v[k]);
+        if(r.file == fileOrder)       columns.set(2*D, r.t, v[0]);
+        if(r.file == fileMSD)         columns.set(2*D+1, r.t, v[0]);
+        return;
     }
     
-    if(NDIM==3) {
-        OvitoVid << cellIndex << "\t" << radius << "\t" << overlap << "\t" << x[0] << "\t" << x[1]
-                 << "\t" << x[2] << "\t" << v[0] << "\t" << v[1] << "\t" << v[2] << endl;
+    switch(r.file)
+    {
+        case fileCOM:
+            if constexpr (D==2) COM << r.t << "\t" << v[0] << "\t" << v[1] << "\n";
+            if constexpr (D==3) COM << r.t << "\t" << v[0] << "\t" << v[1] << "\t" << v[2] << "\n";
+            break;
+        case fileOrientation:
+            if constexpr (D==2) orientation << r.t << "\t" << v[0] << "\t" << v[1] << "\n";
+            if constexpr (D==3) orientation << r.t << "\t" << v[0] << "\t" << v[1] << "\t" << v[2] << "\n";
+            break;
+        case fileOrder:
+            order << r.t << "\t" << v[0] << "\n";
+            break;
+        case fileMSD:
+            MSD << r.t << "\t" << v[0] << "\t" << log(v[0]) << "\t" << log(1.0-v[0]) << "\n";
+            break;
+        case fileFluct:
+            fluct << v[0] << "\t" << v[1] << "\n";
+            break;
     }
 }
 
-void Print::print_corr(double r, double v){
+template <int D>
+void Print<D>::flushWritten()
+// Runs on the writer thread
+{
+    COM.flush();
+    orientation.flush();
+    order.flush();
+    MSD.flush();
+    fluct.flush();
+    columns.flush();
+}
+
+template <int D>
+void Print<D>::print_frame(long int t, double L, vector<double> &R, vector<vector<double>> &x,
+                           vector<vector<double>> &v, vector<int> &over){
+// Append a frame to the binary trajectory; "a.out xyz" turns it into the "XYZ" file format, to be
+// read by molecular dynamics visualization software
+    
+    if(output) video.write(t, L, R, x, v, over);
+}
+
+template <int D>
+void Print<D>::print_corr(double r, double v){
     corr << r << "\t" << v << endl;
 }
 
-void Print::print_orientationCorr(double r, double v){
+template <int D>
+void Print<D>::print_orientationCorr(double r, double v){
     orientationCorr << r << "\t" << v << endl;
 }
 
-void Print::print_pairCorr(double r, double gr){
+template <int D>
+void Print<D>::print_pairCorr(double r, double gr){
     pairCorr << r << "\t" << gr << "\n";
 }
 
-void Print::print_velDist(double v, double prob){
+template <int D>
+void Print<D>::print_structureFactor(double k, double s){
+    // Only runs with mesh correlations have one, so the file is made with the first line
+    if(!output) return;
+    if(!structureFactor.is_open()) structureFactor.open((path+run+"/dat/structureFactor.dat").c_str());
+    structureFactor << k << "\t" << s << "\n";
+}
+
+template <int D>
+void Print<D>::print_velDist(double v, double prob){
     velDist << v << "\t" << prob << "\n";
 }
 
-void Print::print_autoCorr(int t, double vaf){
+template <int D>
+void Print<D>::print_autoCorr(int t, double vaf){
     autoCorr << t << "\t" << vaf << endl;
 }
 
-void Print::print_MSD(int t, double msd){
-    MSD << t << "\t" << msd << "\t" << log(msd) << "\t" << log(1.0-msd) << endl;
+template <int D>
+void Print<D>::print_autoCorrMultiTau(long int lag, double c){
+    // Only runs with the multi-tau correlator have these, so the files are made with the first line
+    if(!output) return;
+    if(!autoCorrMultiTau.is_open()) autoCorrMultiTau.open((path+run+"/dat/autoCorrMultiTau.dat").c_str());
+    autoCorrMultiTau << lag << "\t" << c << "\n";
+}
+
+template <int D>
+void Print<D>::print_vaf(long int lag, double c){
+    if(!output) return;
+    if(!vaf.is_open()) vaf.open((path+run+"/dat/vaf.dat").c_str());
+    vaf << lag << "\t" << c << "\n";
+}
+
+template <int D>
+void Print<D>::print_MSDAveraged(long int lag, double msd){
+    if(!output) return;
+    if(!MSDAveraged.is_open()) MSDAveraged.open((path+run+"/dat/MSDAveraged.dat").c_str());
+    MSDAveraged << lag << "\t" << msd << "\n";
+}
+
+template <int D>
+void Print<D>::print_MSD(int t, double msd){
+    OutputRecord record = {fileMSD, t, {msd, 0.0, 0.0}};
+    writer.push(record);
 }
 
-void Print::print_fluct(double r, double avg, double f){
-    fluct <<  avg << "\t" << f << endl;
+template <int D>
+void Print<D>::print_fluct(double r, double avg, double f){
+    OutputRecord record = {fileFluct, 0, {avg, f, 0.0}};
+    writer.push(record);
 }
 
-void Print::print_dens(double density, double count){
+template <int D>
+void Print<D>::print_dens(double density, double count){
     dens << density << "\t" << count << endl;
 }
 
-void Print::print_summary(	string ID, int noCells, double L, long int numberOfSteps,
+template <int D>
+void Print<D>::print_summary(	string ID, int noCells, double L, long int numberOfSteps,
 							int stepsPerTime, double C1, double C2, double rho,
 							double seconds, long int resetCounter,
-                          	double binder, double order, double variance )
+                          	double binder, double order, double variance, uint64_t seed,
+                          	double skin, bool tuned, double refreshTime, double forceTime,
+                          	double stepTime, double stepsPerRefresh )
 {
     summary << "Run ID:                     " << "\t" << ID << endl;
     summary << "Number of cells:            " << "\t" << noCells << endl;
@@ -197,6 +401,12 @@ void Print::print_summary(	string ID, int noCells, double L, long int numberOfSt
     summary << "Binder cumulant:            " << "\t" << binder << endl;
     summary << "Average order parameter:    " << "\t" << order << endl;
     summary << "Order parameter variance:   " << "\t" << variance << endl;
+    summary << "Random seed:                " << "\t" << seed << endl;
+    summary << "Verlet skin radius:         " << "\t" << skin << (tuned ? " (tuned)" : "") << endl;
+    summary << "List refresh time (ms):     " << "\t" << refreshTime << endl;
+    summary << "Force time per step (ms):   " << "\t" << forceTime << endl;
+    summary << "Time per step (ms):         " << "\t" << stepTime << endl;
+    summary << "Steps per list refresh:     " << "\t" << stepsPerRefresh << endl;
 	
     summary2 << ID << endl;
     summary2 << noCells << endl;
@@ -211,5 +421,11 @@ void Print::print_summary(	string ID, int noCells, double L, long int numberOfSt
     summary2 << binder << endl;
     summary2 << order << endl;
     summary2 << variance << endl;
+    summary2 << seed << endl;
+    summary2 << skin << endl;
+    summary2 << refreshTime << endl;
+    summary2 << forceTime << endl;
+    summary2 << stepTime << endl;
+    summary2 << stepsPerRefresh << endl;
 }
 
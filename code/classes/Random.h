@@ -0,0 +1,73 @@
+
+// *** Counter-based random numbers ***
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11). A draw is
+// a pure function of the seed and a counter (stream, cell, step), with no state carried from one
+// draw to the next. Draws for different cells and steps are independent, can be made in any
+// order and on any thread, and the same seed always gives the same numbers.
+
+#include <cstdint>
+
+struct Random
+{
+    Random();
+
+    // Separate streams for each use, so that e.g. the initial positions do not depend on how
+    // many noise values were drawn before them.
+    enum Stream { radius, position, orientation, relax, noise, centre };
+
+    void uniforms(int, uint32_t, uint64_t, double&, double&);
+    double uniform(int, uint32_t, uint64_t, double, double);
+    double normal(int, uint32_t, uint64_t);
+
+    uint64_t seed;
+};
+
+Random::Random()
+{
+    seed = 0;
+}
+
+inline void Random::uniforms(int stream, uint32_t cell, uint64_t step, double &u1, double &u2)
+// Two independent uniform numbers in [0,1), 53 random bits each.
+{
+    uint32_t c0 = cell, c1 = stream, c2 = (uint32_t)step, c3 = (uint32_t)(step >> 32);
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+
+    for(int round=0; round<10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53 * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57 * c2;
+
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+
+    uint64_t r1 = ((uint64_t)c0 << 32) | c1;
+    uint64_t r2 = ((uint64_t)c2 << 32) | c3;
+    u1 = (r1 >> 11) * 0x1.0p-53;
+    u2 = (r2 >> 11) * 0x1.0p-53;
+}
+
+inline double Random::uniform(int stream, uint32_t cell, uint64_t step, double a, double b)
+// Uniform number in [a,b).
+{
+    double u1, u2;
+    uniforms(stream, cell, step, u1, u2);
+    return a + (b-a)*u1;
+}
+
+inline double Random::normal(int stream, uint32_t cell, uint64_t step)
+// Normal number with mean 0 and variance 1 (Box-Muller).
+{
+    double u1, u2;
+    uniforms(stream, cell, step, u1, u2);
+    return sqrt(-2.0*log(1.0-u1)) * cos(PI2*u2);
+}
@@ -0,0 +1,131 @@
+
+// *** Self-tuning Verlet skin ***
+
+// A thicker skin rs-rn makes every Verlet list longer, so each force loop costs more, but the
+// lists last longer before they have to be rebuilt. The tuner records the wall time of force
+// loops and list refreshes, and how often the lists are refreshed. Once a window of steps has
+// enough refreshes in it, it fits a simple model to them: the force time grows as rs^D, the
+// steps between refreshes grow in proportion to the skin, and a refresh costs the same for any
+// skin. The skin with the lowest predicted time per step is used for the next window.
+
+struct SkinTuner
+{
+    SkinTuner();
+
+    void reset();
+    void addRefresh(double);
+    void addStep(double, double);
+    bool ready();
+    double next(double, double, double, double, int);
+    void save(Checkpoint&);
+    void load(Checkpoint&);
+
+    // Totals since the last reset, for the summary. Times in seconds.
+
+    long int steps, refreshes;
+    double refreshTime, forceTime, stepTime;
+
+private:
+    long int windowSteps, windowRefreshes;
+    double windowRefreshTime, windowForceTime;
+};
+
+SkinTuner::SkinTuner()
+{
+    reset();
+}
+
+void SkinTuner::reset()
+{
+    steps = refreshes = 0;
+    refreshTime = forceTime = stepTime = 0.0;
+    windowSteps = windowRefreshes = 0;
+    windowRefreshTime = windowForceTime = 0.0;
+}
+
+void SkinTuner::addRefresh(double seconds)
+{
+    refreshes++;
+    refreshTime += seconds;
+    windowRefreshes++;
+    windowRefreshTime += seconds;
+}
+
+void SkinTuner::addStep(double force, double total)
+// Force loop time and total time of one step, refresh included.
+{
+    steps++;
+    forceTime += force;
+    stepTime += total;
+    windowSteps++;
+    windowForceTime += force;
+}
+
+bool SkinTuner::ready()
+// A window closes after 5 refreshes, or after 2000 steps when refreshes are rare.
+{
+    return (windowRefreshes >= 5 && windowSteps >= 100) || windowSteps >= 2000;
+}
+
+double SkinTuner::next(double rs, double rn, double rsMin, double rsMax, int D)
+// New skin radius from the window that just closed, at most a factor two away in thickness.
+{
+    if(refreshes == 0) return rs;
+
+    // In a decomposed run every process must choose the same skin, so the times are summed.
+
+    double times[3] = {windowForceTime, windowRefreshTime, refreshTime};
+    globalSum(times, 3);
+
+    double skin0   = rs - rn;
+    double force   = times[0]/windowSteps;                          // Per step
+    double refresh = (windowRefreshes > 0) ? times[1]/windowRefreshes : times[2]/refreshes;
+    double rate    = std::max(windowRefreshes, 1L)/(double)windowSteps;
+
+    double lo = std::max(rsMin - rn, skin0/2);
+    double hi = std::min(rsMax - rn, skin0*2);
+
+    double best = rs;
+    double bestCost = -1.0;
+    for(int m=0; m<=100; m++)
+    {
+        double skin = lo + (hi-lo)*m/100.0;
+        double cost = force*pow((rn+skin)/rs, D) + refresh*rate*skin0/skin;
+        if(bestCost < 0 || cost < bestCost)
+        {
+            bestCost = cost;
+            best = rn+skin;
+        }
+    }
+
+    windowSteps = windowRefreshes = 0;
+    windowRefreshTime = windowForceTime = 0.0;
+
+    return best;
+}
+
+void SkinTuner::save(Checkpoint &file)
+{
+    file.put(steps);
+    file.put(refreshes);
+    file.put(refreshTime);
+    file.put(forceTime);
+    file.put(stepTime);
+    file.put(windowSteps);
+    file.put(windowRefreshes);
+    file.put(windowRefreshTime);
+    file.put(windowForceTime);
+}
+
+void SkinTuner::load(Checkpoint &file)
+{
+    file.get(steps);
+    file.get(refreshes);
+    file.get(refreshTime);
+    file.get(forceTime);
+    file.get(stepTime);
+    file.get(windowSteps);
+    file.get(windowRefreshes);
+    file.get(windowRefreshTime);
+    file.get(windowForceTime);
+}
@@ -0,0 +1,120 @@
+
+// *** Running many parameter points in one process ***
+
+// A sweep file has one run per line, with the same seven values as the command line of a single
+// run: full run ID, single run ID, number of cells, number of steps, lambda_s, lambda_n and rho.
+// This is the input.txt that create-arrays.sh writes.
+//
+// The runs are shared out over a fixed number of workers. Every worker has its own queue, takes
+// runs from the front of it and, once it is empty, steals from the back of the other queues.
+// The queues are filled longest run first, so that the long runs start early and the short ones
+// at the back fill the gaps at the end. After a signal no more runs are started.
+
+#include <deque>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+struct SweepPoint
+{
+    string dir, ID;
+    long int n, steps;
+    double l_s, l_n, rho;
+};
+
+vector<SweepPoint> readSweep(string name)
+{
+    vector<SweepPoint> points;
+    ifstream file(name.c_str());
+    if(!file)
+    {
+        cout << "Cannot read sweep file " << name << ". Status 740\n";
+        exit(740);
+    }
+
+    string line;
+    while(getline(file, line))
+    {
+        istringstream values(line);
+        SweepPoint point;
+        if(values >> point.dir >> point.ID >> point.n >> point.steps >> point.l_s >> point.l_n >> point.rho)
+        {
+            points.push_back(point);
+        }
+        else if(line.find_first_not_of(" \t\r") != string::npos)
+        {
+            cout << "Skipping sweep line \"" << line << "\", need seven values" << endl;
+        }
+    }
+    return points;
+}
+
+struct WorkQueues
+{
+    WorkQueues(int, vector<int>&);
+
+    bool next(int, int&);
+
+private:
+    int workers;
+    vector<deque<int>> queues;
+    unique_ptr<mutex[]> locks;
+};
+
+WorkQueues::WorkQueues(int workers_, vector<int> &tasks)
+// Deal the tasks out in turn, in the order given.
+{
+    workers = workers_;
+    queues.resize(workers);
+    locks.reset(new mutex[workers]);
+    for(size_t m=0; m<tasks.size(); m++) queues[m%workers].push_back(tasks[m]);
+}
+
+bool WorkQueues::next(int worker, int &task)
+// The next task for worker: the front of its own queue, or else the back of another one.
+// False when all queues are empty.
+{
+    for(int m=0; m<workers; m++)
+    {
+        int w = (worker+m)%workers;
+        lock_guard<mutex> guard(locks[w]);
+        if(queues[w].empty()) continue;
+
+        if(m == 0) { task = queues[w].front(); queues[w].pop_front(); }
+        else       { task = queues[w].back();  queues[w].pop_back();  }
+        return true;
+    }
+    return false;
+}
+
+void runSweep(vector<SweepPoint> &points, int workers, function<void(SweepPoint&)> work)
+// Run work on every point with the given number of threads.
+{
+    vector<int> order(points.size());
+    for(size_t m=0; m<points.size(); m++) order[m] = m;
+    stable_sort(order.begin(), order.end(), [&](int a, int b)
+                { return points[a].n*points[a].steps > points[b].n*points[b].steps; });
+
+    workers = max(1, min(workers, (int)points.size()));
+    WorkQueues queues(workers, order);
+    mutex output;
+
+    vector<thread> pool;
+    for(int w=0; w<workers; w++)
+    {
+        pool.emplace_back([&, w]
+        {
+            int task;
+            while(!stopSignal && queues.next(w, task))
+            {
+                work(points[task]);
+
+                lock_guard<mutex> guard(output);
+                cout << (stopSignal ? "Stopped " : "Finished ") << points[task].dir << " " << points[task].ID << endl;
+            }
+        });
+    }
+    for(auto &worker : pool) worker.join();
+}
@@ -0,0 +1,57 @@
+
+// *** The box grid and the lists derived from it ***
+
+// Everything here follows from the size of the simulation area, the neighbor radius, the
+// correlation cutoff and whether the run is decomposed, and none of it changes during a run.
+// Runs of a sweep that have the same simulation area share one copy through a TopologyCache;
+// the first run to need it builds it, the others wait for it.
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+
+template <int D>
+struct Topology
+{
+    vector<Box<D>> grid;                // Stores topology of simulation area
+    vector<vector<int>> boxPairs;       // List of box pairs that are separated by less than a correlation cut-off
+    vector<int> curveOrder;             // Boxes in the order they are visited by a Morton (Z-order) curve
+    vector<vector<int>> boxColours;     // Boxes grouped so that no two boxes of a group have a neighbor in common
+    vector<vector<int>> stencil;        // Boxes searched for the Verlet list of a cell in each box, its own box first
+};
+
+template <int D>
+struct TopologyCache
+{
+    shared_ptr<const Topology<D>> get(double, function<shared_ptr<const Topology<D>>()>);
+
+private:
+    mutex lock;
+    map<double, shared_future<shared_ptr<const Topology<D>>>> built;     // By length of the simulation area
+};
+
+template <int D>
+shared_ptr<const Topology<D>> TopologyCache<D>::get(double L, function<shared_ptr<const Topology<D>>()> build)
+// The topology for simulation area L, made with build if no other run has asked for it yet.
+{
+    promise<shared_ptr<const Topology<D>>> made;
+    shared_future<shared_ptr<const Topology<D>>> ready;
+    bool first = false;
+
+    {
+        lock_guard<mutex> guard(lock);
+        auto found = built.find(L);
+        if(found == built.end())
+        {
+            ready = made.get_future().share();
+            built[L] = ready;
+            first = true;
+        }
+        else ready = found->second;
+    }
+
+    if(first) made.set_value(build());
+    return ready.get();
+}
@@ -0,0 +1,309 @@
+
+// *** Binary trajectory files for the video ***
+
+// A trajectory is two files. The frame file starts with a header (dimensions, number of cells,
+// box length, radii) and then holds the frames one after the other. The index file has one
+// fixed-size entry per frame with its time step and place in the frame file, so frame k is found
+// without reading the frames before it. Both files only ever grow at the end, so a restarted run
+// can cut them back like the other time series. Cells are stored by their original index.
+//
+// Positions are either stored exactly, as doubles, or quantised to a number of bits relative to
+// the box, which runs from -L/2 to L/2. Quantised frames are key frames, with the positions in
+// full, or hold only the change of every coordinate since the frame before, as a variable-length
+// integer. Every so many frames is a key frame, so reading frame k never decodes more than that
+// many frames. Velocities are stored as doubles, or as floats when the positions are quantised,
+// and the overlap colour as an int.
+//
+// TrajectoryReader maps both files into memory. "a.out xyz" uses it to write the XYZ file
+// format read by Ovito.
+
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct TrajectoryEntry
+{
+    uint64_t offset;                    // Start of the frame in the frame file
+    int64_t step;                       // Time step of the frame
+    uint32_t key;                       // 1 for a key frame, 0 for one stored as changes
+    uint32_t bytes;                     // Length of the frame
+};
+
+const char trajectoryMagic[8] = {'J','A','M','T','R','A','J','1'};
+
+struct TrajectoryWriter
+{
+    TrajectoryWriter();
+
+    void setup(int, int);
+    void write(long int, double, vector<double>&, vector<vector<double>>&, vector<vector<double>>&, vector<int>&);
+    void resume(long int, long int);
+
+    ofstream frames, index;
+
+private:
+    int bits;                           // Bits per quantised coordinate, 0 for exact positions
+    int keyInterval;                    // Frames from one key frame to the next
+    long int count;                     // Frames written
+    uint64_t written;                   // Length of the frame file
+    vector<uint32_t> previous;          // Quantised positions of the last frame, empty before a key frame
+
+    template <typename T> void put(const T&);
+    void putVarint(uint64_t);
+};
+
+TrajectoryWriter::TrajectoryWriter()
+{
+    bits = 0;
+    keyInterval = 1;
+    count = 0;
+    written = 0;
+}
+
+void TrajectoryWriter::setup(int bits_, int keyInterval_)
+{
+    bits = max(0, min(bits_, 32));
+    keyInterval = max(1, keyInterval_);
+}
+
+template <typename T>
+void TrajectoryWriter::put(const T &value)
+{
+    frames.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    written += sizeof(T);
+}
+
+void TrajectoryWriter::putVarint(uint64_t value)
+// Seven bits per byte, lowest first, the high bit set on all bytes but the last
+{
+    while(value >= 0x80)
+    {
+        put((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    put((uint8_t)value);
+}
+
+void TrajectoryWriter::write(long int t, double L, vector<double> &R, vector<vector<double>> &x,
+                             vector<vector<double>> &v, vector<int> &over)
+// Append the frame of step t. x and v hold one vector per dimension, all by cell index.
+{
+    int D = x.size();
+    int N = R.size();
+
+    if(written == 0)
+    {
+        frames.write(trajectoryMagic, 8);
+        written += 8;
+        put((int32_t)D);
+        put((int32_t)N);
+        put((int32_t)bits);
+        put((int32_t)keyInterval);
+        put(L);
+        for(int i=0; i<N; i++) put(R[i]);
+    }
+
+    TrajectoryEntry entry;
+    entry.offset = written;
+    entry.step = t;
+    entry.key = (bits == 0 || previous.empty() || count%keyInterval == 0);
+
+    if(bits == 0)
+    {
+        for(int k=0; k<D; k++) for(int i=0; i<N; i++) put(x[k][i]);
+        for(int k=0; k<D; k++) for(int i=0; i<N; i++) put(v[k][i]);
+    }
+    else
+    {
+        uint64_t levels = (uint64_t)1 << bits;
+        uint64_t mask = levels-1;
+        previous.resize((size_t)D*N);
+
+        for(int k=0; k<D; k++) for(int i=0; i<N; i++)
+        {
+            double fraction = x[k][i]/L + 0.5;
+            fraction -= floor(fraction);
+            uint32_t q = (uint32_t)((uint64_t)(fraction*levels) & mask);
+            uint32_t &last = previous[(size_t)k*N+i];
+
+            if(entry.key) put(q);
+            else
+            {
+                // Change since the last frame, taken the short way round the box, in zigzag
+                // order so that small changes of either sign give small numbers.
+                int64_t change = (int64_t)((q - (uint64_t)last) & mask);
+                if(change >= (int64_t)(levels/2)) change -= levels;
+                putVarint(change >= 0 ? 2*(uint64_t)change : 2*(uint64_t)(-change)-1);
+            }
+            last = q;
+        }
+        for(int k=0; k<D; k++) for(int i=0; i<N; i++) put((float)v[k][i]);
+    }
+    for(int i=0; i<N; i++) put((int32_t)over[i]);
+
+    entry.bytes = written - entry.offset;
+    index.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    count++;
+}
+
+void TrajectoryWriter::resume(long int frameBytes, long int indexBytes)
+// Carry on after the files were cut back to these lengths. The next frame is a key frame.
+{
+    written = frameBytes;
+    count = indexBytes/sizeof(TrajectoryEntry);
+    previous.clear();
+}
+
+struct TrajectoryReader
+{
+    TrajectoryReader(string);
+    ~TrajectoryReader();
+
+    void read(long int, long int&, vector<vector<double>>&, vector<vector<double>>&, vector<int>&);
+
+    int D, N, bits;
+    double L;
+    vector<double> R;                   // Radii by cell index
+    long int frames;                    // Number of frames
+
+private:
+    const char *data;                   // The frame file
+    const TrajectoryEntry *entries;     // The index file
+    size_t dataBytes, indexBytes;
+    vector<uint32_t> q;                 // Quantised positions of the last frame decoded
+
+    const char *map(string, size_t&);
+    void fail(string, string, int);
+    template <typename T> T get(const char*&);
+    uint64_t getVarint(const char*&);
+};
+
+void TrajectoryReader::fail(string what, string name, int status)
+{
+    cout << what << " " << name << ". Status " << status << "\n";
+    exit(status);
+}
+
+const char* TrajectoryReader::map(string name, size_t &bytes)
+{
+    int fd = ::open(name.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0) fail("Cannot read trajectory", name, 741);
+    bytes = info.st_size;
+
+    void *p = 0;
+    if(bytes > 0)
+    {
+        p = mmap(0, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED) fail("Cannot map trajectory", name, 741);
+    }
+    ::close(fd);
+    return (const char*)p;
+}
+
+TrajectoryReader::TrajectoryReader(string name)
+// name is the frame file. The index file has the same name, ending in .idx.
+{
+    string indexName = name.substr(0, name.rfind('.')) + ".idx";
+    data = map(name, dataBytes);
+    entries = (const TrajectoryEntry*)map(indexName, indexBytes);
+    frames = indexBytes/sizeof(TrajectoryEntry);
+
+    if(dataBytes < 32 || memcmp(data, trajectoryMagic, 8) != 0) fail("Not a trajectory file", name, 742);
+
+    const char *p = data+8;
+    D = get<int32_t>(p);
+    N = get<int32_t>(p);
+    bits = get<int32_t>(p);
+    get<int32_t>(p);
+    L = get<double>(p);
+    if((size_t)(p-data) + N*sizeof(double) > dataBytes) fail("Trajectory ends early", name, 742);
+    R.resize(N);
+    for(int i=0; i<N; i++) R[i] = get<double>(p);
+
+    if(frames > 0 && entries[frames-1].offset + entries[frames-1].bytes > dataBytes)
+    {
+        fail("Trajectory ends early", name, 742);
+    }
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+    if(dataBytes > 0) munmap((void*)data, dataBytes);
+    if(indexBytes > 0) munmap((void*)entries, indexBytes);
+}
+
+template <typename T>
+T TrajectoryReader::get(const char *&p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+uint64_t TrajectoryReader::getVarint(const char *&p)
+{
+    uint64_t value = 0;
+    for(int shift=0; ; shift+=7)
+    {
+        uint8_t byte = get<uint8_t>(p);
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if(byte < 0x80) return value;
+    }
+}
+
+void TrajectoryReader::read(long int k, long int &step, vector<vector<double>> &x,
+                            vector<vector<double>> &v, vector<int> &over)
+// Frame k: its time step, positions and velocities by dimension, and overlap colours
+{
+    x.assign(D, vector<double>(N));
+    v.assign(D, vector<double>(N));
+    over.resize(N);
+
+    // Quantised positions are built up from the last key frame at or before k.
+
+    long int first = k;
+    while(!entries[first].key) first--;
+
+    for(long int f=first; f<=k; f++)
+    {
+        const char *p = data + entries[f].offset;
+        bool last = (f == k);
+
+        if(bits == 0)
+        {
+            for(int d=0; d<D; d++) for(int i=0; i<N; i++) x[d][i] = get<double>(p);
+            for(int d=0; d<D; d++) for(int i=0; i<N; i++) v[d][i] = get<double>(p);
+        }
+        else
+        {
+            uint64_t levels = (uint64_t)1 << bits;
+            uint64_t mask = levels-1;
+            q.resize((size_t)D*N);
+
+            for(size_t m=0; m<q.size(); m++)
+            {
+                if(entries[f].key) q[m] = get<uint32_t>(p);
+                else
+                {
+                    uint64_t z = getVarint(p);
+                    int64_t change = (z & 1) ? -(int64_t)((z+1)/2) : (int64_t)(z/2);
+                    q[m] = (uint32_t)((q[m] + (uint64_t)change) & mask);
+                }
+            }
+            if(!last) continue;
+
+            for(int d=0; d<D; d++) for(int i=0; i<N; i++) x[d][i] = (q[(size_t)d*N+i]+0.5)*L/levels - 0.5*L;
+            for(int d=0; d<D; d++) for(int i=0; i<N; i++) v[d][i] = get<float>(p);
+        }
+        if(last) for(int i=0; i<N; i++) over[i] = get<int32_t>(p);
+    }
+
+    step = entries[k].step;
+}
@@ -0,0 +1,151 @@
+
+// *** Writing the time series from a thread of their own ***
+
+// The time series are printed every few steps, and formatting them and flushing the files kept
+// the simulation waiting, most of all on the shared file systems of a cluster. Instead the
+// simulation puts each line as a small record into a queue, and a writer thread takes the
+// records off, formats them and flushes the files in batches, when the queue has run empty and
+// the last flush is some time ago.
+//
+// The queue is a ring buffer with one producer, the simulation, and one consumer, the writer.
+// Each side only moves its own end, so neither needs a lock. A full queue makes the producer
+// wait for the writer. drain waits until everything queued so far is written and flushed, and
+// finish does the same and ends the thread.
+//
+// A signal does not end the program on the spot: it sets stopSignal, the run stops at the next
+// step where it looks, and the files are drained and closed on the way out.
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <csignal>
+
+atomic<bool> stopSignal(false);         // Set by SIGINT or SIGTERM
+
+void requestStop(int)
+{
+    stopSignal = true;
+}
+
+struct OutputRecord
+{
+    int file;                           // Which time series, as numbered by the owner of the writer
+    long int t;
+    double value[3];
+};
+
+struct Writer
+{
+    Writer();
+    ~Writer();
+
+    void start(function<void(OutputRecord&)>, function<void()>);
+    void push(OutputRecord&);
+    void drain();
+    void finish();
+
+private:
+    static const size_t capacity = 4096;                // A power of two
+    const chrono::milliseconds flushInterval{200};      // Longest time between flushes while records come in
+
+    vector<OutputRecord> ring;
+    atomic<size_t> head;                // Next slot to fill, moved by the producer
+    atomic<size_t> tail;                // Next slot to write, moved by the writer
+    atomic<size_t> done;                // Records written and flushed
+    atomic<bool> flushNow, stop;
+
+    function<void(OutputRecord&)> format;
+    function<void()> flush;
+    thread worker;
+
+    void loop();
+};
+
+Writer::Writer()
+{
+    head = 0;
+    tail = 0;
+    done = 0;
+    flushNow = false;
+    stop = false;
+}
+
+Writer::~Writer()
+{
+    finish();
+}
+
+void Writer::start(function<void(OutputRecord&)> format_, function<void()> flush_)
+// format writes one record to its file, flush flushes all of them.
+{
+    format = format_;
+    flush = flush_;
+    ring.resize(capacity);
+    worker = thread([this]{ loop(); });
+}
+
+void Writer::push(OutputRecord &record)
+{
+    if(!worker.joinable()) return;
+
+    size_t h = head.load(memory_order_relaxed);
+    while(h - tail.load(memory_order_acquire) == capacity) this_thread::yield();
+
+    ring[h%capacity] = record;
+    head.store(h+1, memory_order_release);
+}
+
+void Writer::loop()
+{
+    size_t t = tail.load(memory_order_relaxed);
+    bool dirty = false;
+    auto lastFlush = chrono::steady_clock::now();
+
+    while(true)
+    {
+        size_t h = head.load(memory_order_acquire);
+
+        if(t != h)
+        {
+            for(; t != h; t++) format(ring[t%capacity]);
+            tail.store(t, memory_order_release);
+            dirty = true;
+            continue;
+        }
+
+        // The queue is empty
+
+        bool stopping = stop.load(memory_order_acquire);
+        if(dirty && (stopping || flushNow.load(memory_order_acquire) ||
+                     chrono::steady_clock::now() - lastFlush > flushInterval))
+        {
+            flush();
+            dirty = false;
+            lastFlush = chrono::steady_clock::now();
+        }
+        if(!dirty) done.store(t, memory_order_release);
+
+        if(stopping && head.load(memory_order_acquire) == t) return;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+void Writer::drain()
+// Wait until all records pushed so far are in the files and flushed.
+{
+    if(!worker.joinable()) return;
+
+    size_t target = head.load(memory_order_relaxed);
+    flushNow = true;
+    while(done.load(memory_order_acquire) < target) this_thread::yield();
+    flushNow = false;
+}
+
+void Writer::finish()
+{
+    if(!worker.joinable()) return;
+
+    stop = true;
+    worker.join();
+}
@@ -10,7 +10,11 @@ run=1
 ID="100000TriplePoint1ZoomOut"
 
 rm -f input.txt
-g++ active_jam_nbr_17.cpp -I boost_1_64_0/ -O3 -o a.out -std=c++11
+g++ active_jam_nbr_17.cpp -I boost_1_64_0/ -O3 -fopenmp -o a.out -std=c++17
+# Domain-decomposed build, started with mpirun -np <p> a.out ...:
+# mpicxx active_jam_nbr_17.cpp -I boost_1_64_0/ -O3 -fopenmp -DUSE_MPI -o a.out -std=c++17
+# Or run all of input.txt in one process, several runs at a time: ./a.out sweep input.txt --workers <n>
+# --kernel cluster needs AVX: add -march=native (or -mavx2) to the build line.
 for i in ${rho[@]}
 do
 	for j in ${l_n[@]}
@@ -1,5 +1,4 @@
 
-#define NDIM 3
 #define PI 3.14159265
 #define PI2 6.28318531
 #define sqrt2 1.41421356
@@ -11,17 +10,36 @@
 #include <chrono>
 #include <time.h>
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <climits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 using namespace std::chrono;
 
+#include "../classes/Checkpoint.h"
 #include "../classes/Cell.h"
 #include "../classes/Box.h"
+#include "../classes/Domain.h"
+#include "../classes/Topology.h"
+#include "../classes/Trajectory.h"
+#include "../classes/Writer.h"
+#include "../classes/Columns.h"
 #include "../classes/Print.h"
+#include "../classes/Random.h"
 #include "../classes/Fluctuations.h"
+#include "../classes/FFT.h"
+#include "../classes/MultiTau.h"
+#include "../classes/AveragedMSD.h"
 #include "../classes/Correlations.h"
+#include "../classes/Clusters.h"
+#include "../classes/SkinTuner.h"
+#include "../classes/Observables.h"
+#include "../classes/Sweep.h"
 #include <boost/lexical_cast.hpp>
-#include <boost/random.hpp>
 
 // 0 for local, 1 for remote run
 
@@ -31,15 +49,18 @@ const bool remote = 0;
 
 const bool makevid = 0;
 
-// Mersenne Twister pseudo-random number generator. Cell radii are drawn from a Gaussian
-// distribution, while noise values are drawn from a normal distribution.
-std::chrono::time_point<std::chrono::high_resolution_clock> t1 = std::chrono::high_resolution_clock::now();
-boost::mt19937 gen(std::chrono::duration_cast<std::chrono::nanoseconds>(t1.time_since_epoch()).count());
-boost::uniform_real<> unidist(-PI, PI);
-boost::normal_distribution<> normdist(0, 1);
-boost::variate_generator< boost::mt19937, boost::uniform_real<> > randuni(gen, unidist);
-boost::variate_generator< boost::mt19937, boost::normal_distribution<> > randnorm(gen, normdist);
+// Bits per coordinate of the positions in the video, relative to the box length, 0 to store them
+// exactly. Every keyFrames-th frame stores the positions in full, the others only their changes.
 
+const int videoBits = 20;
+const int keyFrames = 10;
+
+// Exit status of a run or sweep stopped by SIGINT or SIGTERM, to be carried on with --restart.
+// Statuses are taken modulo 256, so it stays below that; 75 is EX_TEMPFAIL of sysexits.h.
+
+const int stoppedStatus = 75;
+
+template <int D>
 struct Engine
 {
     Engine(string, string, long int, long int, double, double, double);
@@ -47,7 +68,7 @@ struct Engine
 	
     string location;
     
-    int N;                              // Number of cells
+    int N;                              // Number of cells, on all processes together
     double CFself;                      // Self-propulsion force
     double CTnoise;                     // Noise parameter
     double dens;                        // Packing fraction
@@ -63,6 +84,21 @@ struct Engine
     long int countdown;
     long int t;
     long int resetCounter;              // Records the number of times the Verlet skin list is refreshed
+    long int noiseStep;                 // Counts orientation updates, including relaxation, for the noise
+    long int relaxStep;                 // Relaxation steps done so far
+    bool relaxed;                       // Relaxation is over and the initial positions are stored
+    int corrCounter;                    // Steps done in the current autocorrelation window
+    long int checkpointInterval;        // Steps between checkpoints, 0 for none
+    bool restart;                       // Carry on from the checkpoint in the run's folder
+    bool stopped;                       // The run was stopped early by a signal
+    high_resolution_clock::time_point startTime;    // Start of this process's part of the run
+    double elapsed;                     // Seconds spent on the run before a restart
+    string relaxCache;                  // Folder of relaxed passive configurations shared by runs, empty for none
+    bool binarySeries;                  // COM, orientation, order and MSD as binary columns instead of text
+    bool meshCorrelations;              // Spatial correlations and S(k) from FFTs on a mesh instead of pair sums
+    string multiTau;                    // Multi-tau autocorrelations: "none", "orientation" or "all" (with velocities)
+    int msdSamples;                     // Positions kept for the MSD over all time origins, 0 for none
+    bool gridFluctuations;              // Number fluctuations at many radii and centres, on the box grid
 	
     int timeAvg;             			// Number of instances to average correlation functions
     int tCorrelation;      				// Number of time steps of auto-correlation function
@@ -70,53 +106,98 @@ struct Engine
 	
     void start();
     void topology();
+    shared_ptr<const Topology<D>> buildTopology();
     void initCells();
+    std::array<double, D> latticePosition(int);
     void assignCellsToGrid();
+    void binCells(Cells<D>&, CellList&);
+    void refreshNeighbors(bool);
     void buildVerletLists();
-    void relax();
+    int skinNeighbors(int, vector<int>&);
+    void reorderCells();
+    void relax(Print<D>&, Fluctuations<D>&, Correlations<D>&);
     bool newSkinList();
     void calculate_next_positions();
+    void setSkin(double);
     void neighborInteractions();
+    void pairInteraction(int, int, bool);
+    void updateOrientations();
+    void setOrientation(int, double, double);
     void calculate_COM();
     void saveOldPositions();
-    double calculateOrderParameter();
-    vector<double> calculateSystemOrientation();
-    void print_video(Print&);
+    Observables<D>& observe(bool);
+    void print_video(Print<D>&);
     double delta_norm(double);
-    double random_projection(double);
-    double MSD();
+    string checkpointFile(Print<D>&);
+    void writeCheckpoint(Print<D>&, Fluctuations<D>&, Correlations<D>&);
+    bool stopRequested(long int, Print<D>&, Fluctuations<D>&, Correlations<D>&);
+    void readHeader(Checkpoint&);
+    void readCheckpoint(Checkpoint&, Print<D>&, Fluctuations<D>&, Correlations<D>&);
+    string relaxedFile(int);
+    bool readRelaxed(int);
+    void writeRelaxed(int);
     
-    vector<double> COM;                 // Current position of center of mass, with no PBC
-    vector<double> COM0;                // Initial position of center of mass for measuring MSD
-    vector<double> COM_old;             // Stores old center of mass value for Verlet list skin refresh
+    std::array<double, D> COM;                 // Current position of center of mass, with no PBC
+    std::array<double, D> COM0;                // Initial position of center of mass for measuring MSD
+    std::array<double, D> COM_old;             // Stores old center of mass value for Verlet list skin refresh
+    double largest2, second2;                  // Two largest squared displacements from x_old, found in the last step
+    double comStep;                            // Distance the center of mass moved in the last step
     double orderAvg, order2Avg, order4Avg;
     double binder, variance;
     
-    vector<Cell> cell;
-    vector<Box> grid;                   // Stores topology of simulation area
-    vector<vector<int>> boxPairs;       // List of box pairs that are separated by less than a correlation cut-off
+    Cells<D> cell;                        // Structure-of-arrays storage for all cells
+    Domain<D> domain;                     // Slab of the simulation area owned by this process
+    shared_ptr<const Topology<D>> topo;   // Box grid, stencils, colours and box pairs, maybe shared with other runs
+    TopologyCache<D> *topologyCache;      // Where to find topo in a sweep, 0 for a single run
+    CellList boxCells;                  // Cells in each box, refreshed with the Verlet lists
+    bool halfShell;                     // Stencils are half shells, otherwise all neighbors without repeats
+    vector<vector<int>> listBuffer;     // Verlet lists found by each thread, before they are put in place
+    
+    int threads;                        // Number of OpenMP threads for the force loop, 1 for serial
+    Random rng;                         // Counter-based random numbers, seeded from the clock unless given
+    bool clusterKernel;                 // Use the cluster-pair kernel for the force loop
+    bool tuneSkin;                      // Adjust the skin radius during the run to minimise the time per step
+    SkinTuner skinTuner;                // Times force loops and refreshes, picks the next skin radius
+    Observables<D> observables;         // Order parameter, mean direction and MSD of the current step
+    Clusters<D> clusters;               // Cells grouped in clusters of four, for the cluster-pair kernel
     
     double L;                           // Length of the simulation area
     double Lover2;                      // Read: "L-over-two", so we don't have to calculate L/2 every time we need it
     double lp;                          // Length of one box in the grid
     int b;                              // Number of boxes in one dimension
     int nbox;                           // Total number of boxes
-    int nboxnb;                         // Number of boxes neighboring each other: 9 in 2D, 27 in 3D
+    static const int nboxnb = Box<D>::nnb;  // Number of boxes neighboring each other: 9 in 2D, 27 in 3D
 	
     // Note that the performance of the algorithm depends highly on the choice of rn and rs.
 	// Rs should not be so large as to include next-nearest neighbors, because then the algorithm
 	// checks a much bigger Verlet list at every time step. On the other hand, a bigger rs-rn
 	// means fewer global list refreshes, and the global list refreshes are more computationally
-	// expensive.
+	// expensive. With tuneSkin the balance is measured and rs moves between rsMin and rsMax;
+	// rs can be no larger than a box, 2*rn.
 	
     const double rn = 2.8;              // Radius that defines particle's interaction neighborhood
-    const double rs = 1.5*rn;           // Verlet skin radius
     const double rn2 = rn*rn;
-    const double rs2 = rs*rs;
+    const double rsMin = 1.05*rn;
+    const double rsMax = 2.0*rn;
+    double rs;                          // Verlet skin radius
+    double rs2;
+    double rsNext;                      // Skin radius chosen by the tuner, used from the next refresh
+    
+    // Cells that are close in space drift apart in memory as the run goes on. Every reorderInterval
+    // list refreshes the cells are sorted along a space-filling curve over the boxes so that
+    // neighbours are stored close together again. Set to 0 to keep the original order.
+    
+    const int reorderInterval = 10;
+    
+    // Names the distribution of the radii drawn in initCells, for the cache of relaxed
+    // configurations. Change it whenever the radii change.
+    
+    const string radiusDistribution = "normal-1-0.1";
 
 };
 
-Engine::Engine(string dir, string ID, long int n, long int steps, double l_s, double l_n, double rho)
+template <int D>
+Engine<D>::Engine(string dir, string ID, long int n, long int steps, double l_s, double l_n, double rho)
 // Constructor
 {
     fullRun     = dir;
@@ -130,6 +211,28 @@ Engine::Engine(string dir, string ID, long int n, long int steps, double l_s, do
     
     t = 0;
     resetCounter = 0;
+    noiseStep = 0;
+    relaxStep = 0;
+    relaxed = false;
+    corrCounter = 0;
+    checkpointInterval = 0;
+    restart = false;
+    stopped = false;
+    elapsed = 0.0;
+    binarySeries = false;
+    meshCorrelations = false;
+    multiTau = "none";
+    msdSamples = 0;
+    gridFluctuations = false;
+    relaxCache = "";
+    topologyCache = 0;
+    threads = 1;
+    rng.seed = duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+    domain.broadcast(rng.seed);
+    clusterKernel = false;
+    tuneSkin = false;
+    rs = rsNext = 1.5*rn;
+    rs2 = rs*rs;
     
     orderAvg = 0.0;
     order2Avg = 0.0;
@@ -137,12 +240,10 @@ Engine::Engine(string dir, string ID, long int n, long int steps, double l_s, do
     binder = 0.0;
     variance = 0.0;
     
-    COM.assign(NDIM,0.0);
-    COM0.assign(NDIM,0.0);
-    COM_old.assign(NDIM,0.0);
-    
-    if(NDIM==2) nboxnb=9;
-    if(NDIM==3) nboxnb=27;
+    COM.fill(0.0);
+    COM0.fill(0.0);
+    COM_old.fill(0.0);
+    largest2 = second2 = comStep = 0.0;
 	
 	if( remote == 0 )
 	{
@@ -157,70 +258,104 @@ Engine::Engine(string dir, string ID, long int n, long int steps, double l_s, do
 		location = "/home/dmccusker/remote/jamming-dynamics/";
 		timeAvg = 100;
     	tCorrelation = 100;
-    	if(NDIM == 2) cutoff = 140;
-    	if(NDIM == 3) cutoff = 70;
+    	if constexpr (D==2) cutoff = 140;
+    	if constexpr (D==3) cutoff = 70;
 	}
 	
 }
 
-Engine::~Engine()
+template <int D>
+Engine<D>::~Engine()
 // Destructor
 {
-    for (int i=0; i<N; i++) cell[i].VerletList.clear();
-    for (int j=0; j<nbox; j++) grid[j].CellList.clear();
 }
 
-void Engine::start()
+template <int D>
+void Engine<D>::start()
 {
-    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+    startTime = high_resolution_clock::now();
+    
+    Print<D> printer(location, fullRun, run, N, remote, domain.rank == 0, restart);
+    printer.video.setup(videoBits, keyFrames);
+    
+    // A restarted run needs the seed of the checkpoint before the radii are drawn from it.
+    
+    Checkpoint input;
+    if(restart)
+    {
+        input.open(checkpointFile(printer));
+        readHeader(input);
+    }
     
     initCells();
     topology();
     
-    Print printer(location, fullRun, run, N, remote);
-    Fluctuations fluct(L, totalSteps, fluct_int, dens);
-    Correlations corr(L, dens, cutoff, tCorrelation, N, CFself);
+    if(binarySeries)
+    {
+        ostringstream parameters;
+        parameters << setprecision(17) << "\"run\": \"" << fullRun << "/" << run << "\", \"D\": " << D
+                   << ", \"N\": " << N << ", \"L\": " << L << ", \"rho\": " << dens
+                   << ", \"lambda_s\": " << CFself << ", \"lambda_n\": " << CTnoise << ", \"dt\": " << dt
+                   << ", \"steps\": " << totalSteps << ", \"seed\": " << rng.seed;
+        printer.startColumns(parameters.str(), totalSteps/nSkip+1, nSkip, restart);
+    }
+    
+    Fluctuations<D> fluct(L, totalSteps, fluct_int, dens);
+    fluct.threads = threads;
+    if(gridFluctuations) fluct.setupGrid(b, lp);
+    Correlations<D> corr(L, dens, cutoff, tCorrelation, N, CFself);
+    corr.mesh = meshCorrelations;
+    corr.threads = threads;
+    corr.startMultiTau(multiTau != "none", multiTau == "all");
+    if(msdSamples > 0) corr.averagedMSD.setup(N, msdSamples, nSkip);
     
-    assignCellsToGrid();
-    buildVerletLists();
+    if(restart) readCheckpoint(input, printer, fluct, corr);
+    else        refreshNeighbors(false);
     
-    relax();
-	
-	// Store cells' initial positions.
-	
-	for(int i=0; i<N; i++){
-		for(int k=0; k<NDIM; k++) {
-            cell[i].x_real[k] = cell[i].x[k];
-            cell[i].x0[k] = cell[i].x[k];
+    if(!relaxed)
+    {
+        relax(printer, fluct, corr);
+        if(stopped) return;
+        
+        // Store cells' initial positions.
+        
+        for(int k=0; k<D; k++){
+            for(int i=0; i<cell.N; i++) {
+                cell.x_real[k][i] = cell.x[k][i];
+                cell.x0[k][i] = cell.x[k][i];
+            }
         }
+        
+        // Store initial center of mass.
+        
+        calculate_COM();
+        COM0 = COM;
+        
+        saveOldPositions();
+        
+        corrCounter = 0;
+        relaxed = true;
     }
-	
-	// Store initial center of mass.
-	
-    calculate_COM();
-    COM0 = COM;
-	
-    saveOldPositions();
-    
-    int corrCounter = 0;
     
     while(countdown != 0){
        
         calculate_next_positions();
 		
-        if(t%fluct_int == 0)
+        if(t%fluct_int == 0 && !fluct.grid)
         {
 			fluct.measureFluctuations(cell, COM, printer);
 		}
         
-        // Print data every nSkip steps.
+        // Print data every nSkip steps. The grid measures thousands of volumes at a time, so it
+        // does not need the shorter interval.
         
         if(t%nSkip == 0)
         {
-            fluct.measureFluctuations(cell, COM, printer);
+            if(fluct.grid) fluct.measureGrid(cell, rng, t);
+            else           fluct.measureFluctuations(cell, COM, printer);
             
-            double order = calculateOrderParameter();
-            vector<double> orientation = calculateSystemOrientation();
+            Observables<D> &obs = observe(true);
+            double order = obs.order;
             
             double order2 = order*order;
             orderAvg+=order;
@@ -229,10 +364,12 @@ void Engine::start()
             
             printer.print_COM(t, COM);
             printer.print_order(t, order);
-            printer.print_orientation(t, orientation);
-            printer.print_MSD(t, MSD());
+            printer.print_orientation(t, obs.orientation);
+            printer.print_MSD(t, obs.MSD);
+            
+            if(corr.averagedMSD.active) corr.averagedMSD.add(t, cell, COM);
             
-            if(countdown<film && makevid)
+            if(countdown<film && makevid && domain.size == 1)
             {
                 print_video(printer);
             }
@@ -242,14 +379,32 @@ void Engine::start()
         
         if( t%(totalSteps/timeAvg) == 0 && t!=0 )
         {
-            assignCellsToGrid();
-            buildVerletLists();
+            refreshNeighbors(false);
             
-            corr.orientation0 = calculateSystemOrientation();
-            corr.spatialCorrelations(boxPairs, grid, cell);
-            corr.velDist(cell);
+            corr.orientation0 = observe(false).orientation;
             
-            fluct.density_distribution(cell, grid);
+            if(domain.size == 1)
+            {
+                corr.spatialCorrelations(topo->boxPairs, boxCells, cell);
+                corr.velDist(cell);
+                fluct.density_distribution(boxCells, nbox);
+            }
+            else
+            {
+                // Pairs of cells up to the cutoff span many slabs, so process 0 collects all cells
+                
+                Cells<D> all;
+                CellList allCells;
+                domain.gather(cell, all);
+                
+                if(domain.rank == 0)
+                {
+                    binCells(all, allCells);
+                    corr.spatialCorrelations(topo->boxPairs, allCells, all);
+                    corr.velDist(all);
+                    fluct.density_distribution(allCells, nbox);
+                }
+            }
             
             corrCounter = 0;
         }
@@ -258,15 +413,25 @@ void Engine::start()
         
         if( corrCounter < tCorrelation )
         {
-            vector<double> orient = calculateSystemOrientation();
-            corr.autocorrelation( corrCounter, orient );
+            corr.autocorrelation( corrCounter, observe(false).orientation );
             corrCounter++;
         }
         
+        if(corr.orientationMultiTau) corr.multiTauStep(observe(false).orientation, cell);
+        
         t++;
         countdown--;
+        
+        if(checkpointInterval > 0 && t%checkpointInterval == 0 && countdown != 0)
+        {
+            writeCheckpoint(printer, fluct, corr);
+        }
+        
+        if(countdown != 0 && stopRequested(t, printer, fluct, corr)) break;
     }
     
+    if(stopped) return;
+    
     orderAvg  /= (double)totalSteps/(double)nSkip;
     order2Avg /= (double)totalSteps/(double)nSkip;
     order4Avg /= (double)totalSteps/(double)nSkip;
@@ -275,120 +440,168 @@ void Engine::start()
     
     corr.printCorrelations(timeAvg, printer);
     fluct.print_density_distribution(timeAvg, printer);
+    fluct.print_grid(printer);
+    
+    // Mean costs over all processes, in milliseconds
+    
+    double costs[3] = { skinTuner.refreshTime/max(skinTuner.refreshes, 1L),
+                        skinTuner.forceTime/max(skinTuner.steps, 1L),
+                        skinTuner.stepTime/max(skinTuner.steps, 1L) };
+    globalSum(costs, 3);
+    for(int m=0; m<3; m++) costs[m] *= 1e3/domain.size;
+    double stepsPerRefresh = (double)skinTuner.steps/max(skinTuner.refreshes, 1L);
+    
+    // Wall time of the whole run, the parts before any restarts included, like the counts above
     
     high_resolution_clock::time_point t2 = high_resolution_clock::now();
-    auto duration = duration_cast<seconds>( t2 - t1 ).count();
+    long int duration = (long int)(elapsed + duration_cast<std::chrono::duration<double>>( t2 - startTime ).count());
     printer.print_summary(	run, N, L, t, 1./dt, CFself, CTnoise, dens, duration, resetCounter,
-							binder, orderAvg, variance	);
+							binder, orderAvg, variance, rng.seed,
+							rs, tuneSkin, costs[0], costs[1], costs[2], stepsPerRefresh	);
 }
 
-void Engine::initCells()
+template <int D>
+void Engine<D>::initCells()
 {
     double volume = 0;
     
-    // Create vector of cell objects and assign their radii.
+    // The radii of all cells, also those owned by other processes, set the volume.
 
     for(int i=0; i<N; i++){
-        Cell *newCell = new Cell();
-        cell.push_back(*newCell);
-        cell[i].index = i;
-        
-        double cellRad = 1. + randnorm()/10;
-        cell[i].R  = cellRad;
-        cell[i].Rinv = 1.0/cellRad;
-        if(NDIM==2) volume += cellRad*cellRad;
-        if(NDIM==3) volume += cellRad*cellRad*cellRad;
+        double cellRad = 1. + rng.normal(Random::radius, i, 0)/10;
+        if constexpr (D==2) volume += cellRad*cellRad;
+        if constexpr (D==3) volume += cellRad*cellRad*cellRad;
     }
     
     // Simulation area/volume depends on cell sizes.
     
-    if(NDIM==2) L = sqrt( PI * volume / dens );
-    if(NDIM==3) L = cbrt( 4.0 * PI * volume / (3.0*dens) );
+    if constexpr (D==2) L = sqrt( PI * volume / dens );
+    if constexpr (D==3) L = cbrt( 4.0 * PI * volume / (3.0*dens) );
     Lover2 = L/2.0;
+    cell.L = L;
+    cell.Lover2 = Lover2;
     
-    // Set up initial cell configuration in an hexagonal lattice, apply periodic boundaries.
+    // Each process keeps the cells that start in its slab of box layers. The layers are the
+    // ones topology() sets up.
     
-    int rootN = 0;
-    if(NDIM==2) rootN = sqrt(N);
-    if(NDIM==3) rootN = cbrt(N);
-    double spacing = L/rootN;
+    int layers = static_cast<int>(floor(L/(2*rn)));
+    domain.setup(layers, L/layers, Lover2);
     
+    vector<int> own;
     for (int i=0; i<N; i++) {
+        if( domain.size == 1 || domain.owns(latticePosition(i)[D-1]) ) own.push_back(i);
+    }
+    
+    // Allocate the cell arrays, assign the radii, positions and orientations.
+    
+    cell.resize(own.size(), dt);
+    
+    for (int n=0; n<cell.N; n++) {
         
-        cell[i].L = L;
-        cell[i].Lover2 = Lover2;
-        cell[i].dt = dt;
+        int i = own[n];
+        cell.index[n] = i;
         
-        int j = i/rootN;
-        int k = i/(rootN*rootN);
+        double cellRad = 1. + rng.normal(Random::radius, i, 0)/10;
+        cell.R[n]  = cellRad;
+        cell.Rinv[n] = 1.0/cellRad;
         
-        if(NDIM==2){
-            cell[i].x[0]    = -Lover2 + spacing*(i%rootN) + randnorm()/10.;
-            cell[i].x[1]    = -Lover2 + spacing*j + randnorm()/10.;
-            if( j%2 == 0 ) { cell[i].x[0] += 1.0; }
-            
-            cell[i].theta = PI/2.0;
-            cell[i].phi = randuni();
-            cell[i].cosp = cos(cell[i].phi);
-            cell[i].sinp = sin(cell[i].phi);
-        }
-        
-        if(NDIM==3) {
-            cell[i].x[0] = -Lover2 + spacing*(i%rootN) + randnorm()/10.;
-            cell[i].x[1] = -Lover2 + spacing*j + randnorm()/10. - L*k ;
-            cell[i].x[2] = -Lover2 + spacing*k + randnorm()/10.;
-            if( j%2 == 0 ) { cell[i].x[0] += 1.0; }
-            if( k%2 == 0 ) { cell[i].x[1] += 1.0; }
-            
-            cell[i].theta = (randuni() + PI)/2.0;
-            cell[i].phi = randuni();
-            cell[i].cosp = cos(cell[i].phi);
-            cell[i].sinp = sin(cell[i].phi);
-            cell[i].cost = cos(cell[i].theta);
-            cell[i].sint = sin(cell[i].theta);
-        }
+        std::array<double, D> x = latticePosition(i);
+        for (int k=0; k<D; k++) cell.x[k][n] = x[k];
+        
+        if constexpr (D==2) setOrientation(n, rng.uniform(Random::orientation, i, 0, -PI, PI), 0.0);
         
-        cell[i].periodicAngles();
-        cell[i].PBC();
+        if constexpr (D==3) {
+            double theta = (rng.uniform(Random::orientation, i, 1, -PI, PI) + PI)/2.0;
+            setOrientation(n, rng.uniform(Random::orientation, i, 0, -PI, PI), theta);
+        }
+    }
+}
+
+template <int D>
+std::array<double, D> Engine<D>::latticePosition(int i)
+// Initial position of cell i: a hexagonal lattice with some noise, inside the periodic boundaries.
+{
+    int rootN = 0;
+    if constexpr (D==2) rootN = sqrt(N);
+    if constexpr (D==3) rootN = cbrt(N);
+    double spacing = L/rootN;
+    
+    int j = i/rootN;
+    int k = i/(rootN*rootN);
+    
+    std::array<double, D> x;
+    
+    if constexpr (D==2){
+        x[0]    = -Lover2 + spacing*(i%rootN) + rng.normal(Random::position, i, 0)/10.;
+        x[1]    = -Lover2 + spacing*j + rng.normal(Random::position, i, 1)/10.;
+        if( j%2 == 0 ) { x[0] += 1.0; }
+    }
+    
+    if constexpr (D==3) {
+        x[0] = -Lover2 + spacing*(i%rootN) + rng.normal(Random::position, i, 0)/10.;
+        x[1] = -Lover2 + spacing*j + rng.normal(Random::position, i, 1)/10. - L*k ;
+        x[2] = -Lover2 + spacing*k + rng.normal(Random::position, i, 2)/10.;
+        if( j%2 == 0 ) { x[0] += 1.0; }
+        if( k%2 == 0 ) { x[1] += 1.0; }
+    }
+    
+    for (int m=0; m<D; m++) {
+        if(x[m] >= Lover2)      x[m] -= L;
+        else if(x[m] < -Lover2) x[m] += L;
     }
+    
+    return x;
 }
 
-void Engine::topology()
+template <int D>
+void Engine<D>::topology()
 // lp is ~at least~ the assigned neighbor region diameter. It can be a little bit bigger such that
 // we have an integer number of equally-sized boxes.
 // Dynamics are incorrect if b<2 (small number of particles).
 {
     lp = 2*rn;
     b = static_cast<int>(floor(L/lp));
-    if(NDIM==2) nbox = b*b;
-    if(NDIM==3) nbox = b*b*b;
+    if constexpr (D==2) nbox = b*b;
+    if constexpr (D==3) nbox = b*b*b;
     lp = L/floor(L/lp);
     
+    halfShell = (b >= 3 && domain.size == 1);
+    
+    if(topologyCache) topo = topologyCache->get(L, [this]{ return buildTopology(); });
+    else              topo = buildTopology();
+}
+
+template <int D>
+shared_ptr<const Topology<D>> Engine<D>::buildTopology()
+// The grid of boxes and the lists derived from it. Needs lp, b, nbox and halfShell from topology().
+{
+    auto made = make_shared<Topology<D>>();
+    Topology<D> &t = *made;
+    
+    t.grid.resize(nbox);
     for (int k=0; k<nbox; k++) {
-        Box *newBox = new Box;
-        grid.push_back(*newBox);
-        grid[k].serial_index = k;
+        t.grid[k].serial_index = k;
     }
     
     // Label box indices, and find each box's neighbors. Including itself, each box has 9 neighbors
     // in 2D and 27 in 3D.
     
-    boxPairs.reserve(b*(b+1)/2);
+    t.boxPairs.reserve(b*(b+1)/2);
     
-    if(NDIM==2){
+    if constexpr (D==2){
         for(int i=0; i<b; i++){
             for(int j=0; j<b; j++){
                 int p = i+(j*b);
-                grid[p].vector_index[0] = i;
-                grid[p].vector_index[1] = j;
+                t.grid[p].vector_index[0] = i;
+                t.grid[p].vector_index[1] = j;
                 
-                grid[p].min[0] = -Lover2 + i*L/b;
-                grid[p].min[1] = -Lover2 + j*L/b;
-                grid[p].max[0] = -Lover2 + (i+1)*L/b;
-                grid[p].max[1] = -Lover2 + (j+1)*L/b;
+                t.grid[p].min[0] = -Lover2 + i*L/b;
+                t.grid[p].min[1] = -Lover2 + j*L/b;
+                t.grid[p].max[0] = -Lover2 + (i+1)*L/b;
+                t.grid[p].max[1] = -Lover2 + (j+1)*L/b;
                
-                for (int m=0; m<NDIM; m++) {
-                    grid[p].center[m] = (grid[p].min[m] + grid[p].max[m]) / 2.;
+                for (int m=0; m<D; m++) {
+                    t.grid[p].center[m] = (t.grid[p].min[m] + t.grid[p].max[m]) / 2.;
                 }
             }
         }
@@ -398,35 +611,35 @@ void Engine::topology()
                     int p = i;
                     int q = j;
                     
-                    if (grid[k].vector_index[0] == 0   && i==0) p=p+b;
-                    if (grid[k].vector_index[0] == b-1 && i==2) p=p-b;
-                    if (grid[k].vector_index[1] == 0   && j==0) q=q+b;
-                    if (grid[k].vector_index[1] == b-1 && j==2) q=q-b;
+                    if (t.grid[k].vector_index[0] == 0   && i==0) p=p+b;
+                    if (t.grid[k].vector_index[0] == b-1 && i==2) p=p-b;
+                    if (t.grid[k].vector_index[1] == 0   && j==0) q=q+b;
+                    if (t.grid[k].vector_index[1] == b-1 && j==2) q=q-b;
                     
-                    grid[k].neighbors[i+(j*3)] = k + (p-1) + (q-1)*b;
+                    t.grid[k].neighbors[i+(j*3)] = k + (p-1) + (q-1)*b;
                 }
             }
         }
     }
     
-    if(NDIM==3){
+    if constexpr (D==3){
         for(int i=0; i<b; i++){
             for(int j=0; j<b; j++){
                 for(int k=0; k<b; k++){
                     int p = i+(j*b)+(k*b*b);
-                    grid[p].vector_index[0] = i;
-                    grid[p].vector_index[1] = j;
-                    grid[p].vector_index[2] = k;
-
-                    grid[p].min[0] = -Lover2 + i*lp;
-                    grid[p].min[1] = -Lover2 + j*lp;
-                    grid[p].min[2] = -Lover2 + k*lp;
-                    grid[p].max[0] = grid[p].min[0] + lp;
-                    grid[p].max[1] = grid[p].min[1] + lp;
-                    grid[p].max[2] = grid[p].min[2] + lp;
+                    t.grid[p].vector_index[0] = i;
+                    t.grid[p].vector_index[1] = j;
+                    t.grid[p].vector_index[2] = k;
+
+                    t.grid[p].min[0] = -Lover2 + i*lp;
+                    t.grid[p].min[1] = -Lover2 + j*lp;
+                    t.grid[p].min[2] = -Lover2 + k*lp;
+                    t.grid[p].max[0] = t.grid[p].min[0] + lp;
+                    t.grid[p].max[1] = t.grid[p].min[1] + lp;
+                    t.grid[p].max[2] = t.grid[p].min[2] + lp;
                     
-                    for (int m=0; m<NDIM; m++) {
-                        grid[p].center[m] = (grid[p].min[m] + grid[p].max[m]) / 2.;
+                    for (int m=0; m<D; m++) {
+                        t.grid[p].center[m] = (t.grid[p].min[m] + t.grid[p].max[m]) / 2.;
                     }
                 }
             }
@@ -439,20 +652,86 @@ void Engine::topology()
                         int a2 = j;
                         int a3 = k;
                         
-                        if (grid[p].vector_index[0] == 0   && i==0) a1=a1+b;
-                        if (grid[p].vector_index[0] == b-1 && i==2) a1=a1-b;
-                        if (grid[p].vector_index[1] == 0   && j==0) a2=a2+b;
-                        if (grid[p].vector_index[1] == b-1 && j==2) a2=a2-b;
-                        if (grid[p].vector_index[2] == 0   && k==0) a3=a3+b;
-                        if (grid[p].vector_index[2] == b-1 && k==2) a3=a3-b;
+                        if (t.grid[p].vector_index[0] == 0   && i==0) a1=a1+b;
+                        if (t.grid[p].vector_index[0] == b-1 && i==2) a1=a1-b;
+                        if (t.grid[p].vector_index[1] == 0   && j==0) a2=a2+b;
+                        if (t.grid[p].vector_index[1] == b-1 && j==2) a2=a2-b;
+                        if (t.grid[p].vector_index[2] == 0   && k==0) a3=a3+b;
+                        if (t.grid[p].vector_index[2] == b-1 && k==2) a3=a3-b;
                         
-                        grid[p].neighbors[i+(j*3)+(k*9)] = p + (a1-1) + (a2-1)*b + (a3-1)*b*b;
+                        t.grid[p].neighbors[i+(j*3)+(k*9)] = p + (a1-1) + (a2-1)*b + (a3-1)*b*b;
                     }
                 }
             }
         }
     }
     
+    // Order the boxes along a Morton curve: interleave the bits of the box's vector index and sort.
+    
+    vector<pair<unsigned long long, int>> morton(nbox);
+    for (int p=0; p<nbox; p++){
+        unsigned long long code = 0;
+        for (int bit=0; bit<21; bit++){
+            for (int k=0; k<D; k++){
+                unsigned long long c = (t.grid[p].vector_index[k] >> bit) & 1;
+                code |= c << (D*bit + k);
+            }
+        }
+        morton[p] = make_pair(code, p);
+    }
+    sort(morton.begin(), morton.end());
+    
+    t.curveOrder.resize(nbox);
+    for (int p=0; p<nbox; p++) t.curveOrder[p] = morton[p].second;
+    
+    // Colour the boxes for the threaded force loop. Along each axis, boxes 0,1,2,0,1,2,... get
+    // colours 0,1,2 and the b%3 boxes left over at the end get a colour of their own, so that two
+    // boxes of the same colour are at least three boxes apart, also across the periodic boundary.
+    // Needs b>=3, otherwise the force loop stays serial.
+    
+    t.boxColours.clear();
+    if (b >= 3){
+        int nc = 3 + b%3;
+        int ncolours = 1;
+        for (int k=0; k<D; k++) ncolours *= nc;
+        
+        vector<vector<int>> colours(ncolours);
+        for (int m=0; m<nbox; m++){
+            int p = t.curveOrder[m];
+            int colour = 0;
+            for (int k=D-1; k>=0; k--){
+                int vi = t.grid[p].vector_index[k];
+                int c = (vi < 3*(b/3)) ? vi%3 : 3+vi-3*(b/3);
+                colour = colour*nc + c;
+            }
+            colours[colour].push_back(p);
+        }
+        for (int c=0; c<ncolours; c++){
+            if (!colours[c].empty()) t.boxColours.push_back(colours[c]);
+        }
+    }
+    
+    // Verlet list stencils. The neighbors are numbered so that the box itself sits in the middle,
+    // at nboxnb/2, and the boxes after it form half of the shell around it (13 of 26 in 3D, 4 of 8
+    // in 2D). Each pair of boxes then appears in exactly one stencil. With b<3 a box is its own
+    // neighbor on the other side, so there every box searches all its distinct neighbors and
+    // only pairs j>i are kept. The same goes for a decomposed run: ghosts are stored after the own
+    // cells and have no lists, so an own cell must find its ghost neighbors in every direction.
+    
+    t.stencil.assign(nbox, vector<int>());
+    for (int p=0; p<nbox; p++){
+        if (halfShell){
+            for (int m=nboxnb/2; m<nboxnb; m++) t.stencil[p].push_back(t.grid[p].neighbors[m]);
+        }
+        else {
+            t.stencil[p].push_back(p);
+            for (int m=0; m<nboxnb; m++){
+                int q = t.grid[p].neighbors[m];
+                if (find(t.stencil[p].begin(), t.stencil[p].end(), q) == t.stencil[p].end()) t.stencil[p].push_back(q);
+            }
+        }
+    }
+    
     // Build a list of boxes whose entire areas are separated by less than the cutoff
     // radius. Include the entire diagonal length of the boxes, not just their center-center
     // distance, so add sqrt2(3)*lp to the cutoff distance.
@@ -460,28 +739,32 @@ void Engine::topology()
     for (int p=0; p<nbox; p++){
         for(int q=p; q<nbox; q++){
             double boxDist2 = 0.0;
-            for (int k=0; k<NDIM; k++){
-                double dr = delta_norm(grid[p].center[k]-grid[q].center[k]);
+            for (int k=0; k<D; k++){
+                double dr = delta_norm(t.grid[p].center[k]-t.grid[q].center[k]);
                 boxDist2+=dr*dr;
             }
             double boxCutoff = 0.0;
-            if(NDIM==2) boxCutoff = cutoff+(sqrt2*lp);
-            if(NDIM==3) boxCutoff = cutoff+(sqrt3*lp);
+            if constexpr (D==2) boxCutoff = cutoff+(sqrt2*lp);
+            if constexpr (D==3) boxCutoff = cutoff+(sqrt3*lp);
             if (boxDist2 < boxCutoff*boxCutoff)
             {
                 vector<int> temp;
                 temp.assign(2,0);
-                temp[0] = grid[p].serial_index;
-                temp[1] = grid[q].serial_index;
-                boxPairs.push_back(temp);
+                temp[0] = t.grid[p].serial_index;
+                temp[1] = t.grid[q].serial_index;
+                t.boxPairs.push_back(temp);
             }
         }
     }
+    
+    return made;
 }
 
-void Engine::relax()
+template <int D>
+void Engine<D>::relax(Print<D> &printer, Fluctuations<D> &fluct, Correlations<D> &corr)
 // Relax the system as passive particles to allow many rearrangements.
 // Then, allow to thermalize, slowly increasing activity to final value.
+// A restarted run carries on from relaxStep.
 {
  	int trelax = 0;
     int tthermalize = 0;
@@ -500,115 +783,223 @@ void Engine::relax()
 	
     double CFself_old = CFself;
     
-    CFself = 0;
+    // The passive phase depends only on the cells, not on the activity or the noise, so runs of
+    // a sweep can share it through the cache.
+    
+    if(!relaxCache.empty() && relaxStep < trelax && readRelaxed(trelax)) relaxStep = trelax;
     
-    for(int t_=0; t_<trelax; t_++)
+    while(relaxStep < trelax+tthermalize)
     {
-        for(int i=0; i<N; i++)
+        if(relaxStep < trelax)
+        {
+            int t_ = relaxStep;
+            CFself = 0;
+            
+            for(int i=0; i<cell.N; i++)
+            {
+                double u1, u2;
+                rng.uniforms(Random::relax, cell.index[i], t_, u1, u2);
+                setOrientation(i, -PI + PI2*u1, PI*u2);
+            }
+        }
+        else
         {
-            cell[i].phi = randuni();
-            if(NDIM==3) cell[i].theta = (randuni()+PI)/2.0;
+            int t_ = relaxStep - trelax;
+            CFself = CFself_old - (tthermalize - t_)*CFself_old/tthermalize;
         }
         
         calculate_next_positions();
-    }
-    
-    for(int t_=0; t_<tthermalize; t_++)
-    {
-        CFself = CFself_old - (tthermalize - t_)*CFself_old/tthermalize;
-        calculate_next_positions();
+        relaxStep++;
+        
+        // Carry on from the cached configuration just as a later run will, so that the results
+        // do not depend on whether the cache had it.
+        
+        if(relaxStep == trelax && !relaxCache.empty())
+        {
+            writeRelaxed(trelax);
+            readRelaxed(trelax);
+        }
+        
+        if(checkpointInterval > 0 && relaxStep%checkpointInterval == 0)
+        {
+            writeCheckpoint(printer, fluct, corr);
+        }
+        
+        if(stopRequested(relaxStep, printer, fluct, corr)) return;
     }
     
     CFself = CFself_old;
 	
     resetCounter = 0;
+    skinTuner.reset();
+}
+
+template <int D>
+void Engine<D>::assignCellsToGrid()
+{
+    binCells(cell, boxCells);
+}
+
+template <int D>
+void Engine<D>::binCells(Cells<D> &cell, CellList &boxCells)
+// Boxes are labelled p = i + j*b (+ k*b*b), so a cell's box follows directly from its
+// coordinates. Cells, ghosts included, are then counting-sorted by box into boxCells.
+{
+    int n = cell.N + cell.nGhost;
+    for (int i=0; i<n; i++)
+    {
+        int p = 0;
+        int stride = 1;
+        for (int k=0; k<D; k++)
+        {
+            int c = (int)((cell.x[k][i] + Lover2)/lp);
+            if(c >= b)     c = b-1;                 // x = Lover2 - epsilon can round up
+            else if(c < 0) c = 0;
+            p += c*stride;
+            stride *= b;
+        }
+        cell.box[i] = p;
+    }
+    
+    boxCells.sort(cell.box, nbox);
+}
+
+template <int D>
+void Engine<D>::refreshNeighbors(bool reorder)
+// Rebin the cells and rebuild the Verlet lists. In a decomposed run, cells first move to the
+// process that owns them, and the ghosts are collected after the own cells are reordered.
+{
+    if(domain.size == 1)
+    {
+        assignCellsToGrid();
+        if(reorder) reorderCells();
+        buildVerletLists();
+        return;
+    }
+    
+    domain.migrate(cell);
+    if(reorder)
+    {
+        assignCellsToGrid();
+        reorderCells();
+    }
+    domain.exchangeGhosts(cell);
+    assignCellsToGrid();
+    buildVerletLists();
+}
+
+template <int D>
+void Engine<D>::reorderCells()
+// Store cells box by box, visiting the boxes along the Morton curve. Must follow assignCellsToGrid.
+{
+    vector<int> order;
+    order.reserve(cell.N);
+    
+    for (int m=0; m<nbox; m++)
+    {
+        int p = topo->curveOrder[m];
+        int max = boxCells.size(p);
+        int *inBox = boxCells.cells(p);
+        order.insert(order.end(), inBox, inBox+max);
+    }
+    
+    cell.permute(order);
+    boxCells.sort(cell.box, nbox);
 }
 
-void Engine::assignCellsToGrid()
-// A cell can be, at most, a distance of lp*√3/2 (3D) or lp*√2/2 (2D) from its closest box center.
-// Starting at this distance, search through all boxes to find which box the cell is in.
+template <int D>
+void Engine<D>::buildVerletLists()
+// Half lists in compressed-sparse-row form, in two passes. Each thread takes a block of cells,
+// finds their neighbors and counts them. A prefix sum over the counts gives the offsets, and
+// each thread then copies its lists into place. The lists do not depend on the number of threads.
+// Ghosts get empty lists.
 {
-    for (int j=0; j<nbox; j++) grid[j].CellList.clear();
+    int N = cell.N;
+    int stored = cell.N + cell.nGhost;
+    ivec &start = cell.verletStart;
+    start.resize(stored+1);
+    listBuffer.resize(threads);
     
-    for (int i=0; i<N; i++)
+    #pragma omp parallel num_threads(threads)
     {
-        double r2 = lp*lp*0.25*NDIM;
-        for (int j=0; j<nbox; j++)
+        int id = 0;
+        int nthreads = 1;
+#ifdef _OPENMP
+        id = omp_get_thread_num();
+        nthreads = omp_get_num_threads();
+#endif
+        int first = (long int)N*id/nthreads;
+        int last  = (long int)N*(id+1)/nthreads;
+        
+        vector<int> &buffer = listBuffer[id];
+        buffer.clear();
+        for(int i=first; i<last; i++) start[i+1] = skinNeighbors(i, buffer);
+        
+        #pragma omp barrier
+        #pragma omp single
         {
-            double d2 = 0.0;
-            for (int k=0; k<NDIM; k++)
-            {
-                double dr = cell[i].x[k] - grid[j].center[k];
-                d2 += dr*dr;
-            }
-            if(d2 < r2) { r2 = d2; cell[i].box = j; }
+            start[0] = 0;
+            for(int i=0; i<N; i++) start[i+1] += start[i];
+            for(int i=N; i<stored; i++) start[i+1] = start[N];
+            cell.verletList.resize(start[N]);
         }
-        grid[cell[i].box].CellList.push_back(i);
+        
+        copy(buffer.begin(), buffer.end(), cell.verletList.begin() + start[first]);
     }
+    
+    if(clusterKernel) clusters.build(cell, topo->grid, boxCells, rs2);
 }
 
-void Engine::buildVerletLists()
+template <int D>
+int Engine<D>::skinNeighbors(int i, vector<int> &list)
+// Cells within the skin radius that cell i is responsible for: j>i in its own box, all cells in
+// the rest of the stencil. Appends them to list and returns how many there are.
 {
-    for(int i=0; i<N; i++)
+    int count = 0;
+    const vector<int> &boxes = topo->stencil[cell.box[i]];
+    int nboxes = boxes.size();
+    
+    for(int m=0; m<nboxes; m++)
     {
-        cell[i].VerletList.clear();
-        for(int m=0; m<nboxnb; m++)
+        bool upper = (m == 0 || !halfShell);
+        int max = boxCells.size(boxes[m]);
+        int *inBox = boxCells.cells(boxes[m]);
+        for(int k=0; k<max; k++)
         {
-            int p = grid[cell[i].box].neighbors[m];
-            int max = grid[p].CellList.size();
-            for(int k=0; k<max; k++)
+            int j = inBox[k];
+            if(upper && j <= i) continue;
+            
+            double d2 = 0.0;
+            for(int n=0; n<D; n++)
             {
-                int j = grid[p].CellList[k];
-                if(j > i)
-                {
-                    double d2 = 0.0;
-                    double dx = delta_norm(cell[j].x[0] - cell[i].x[0]);
-                    double dy = delta_norm(cell[j].x[1] - cell[i].x[1]);
-					
-                    if(NDIM==3)
-                    {
-                    	double dz = delta_norm(cell[j].x[2] - cell[i].x[2]);
-                    	d2 += dz*dz;
-					}
-					
-                    d2 += dx*dx+dy*dy;
-					
-                    if( d2 < rs2 )
-                    {
-                        cell[i].VerletList.push_back(j);
-                        cell[j].VerletList.push_back(i);
-                    }
-                }
+                double dn = delta_norm(cell.x[n][j] - cell.x[n][i]);
+                d2 += dn*dn;
+            }
+            
+            if( d2 < rs2 )
+            {
+                list.push_back(j);
+                count++;
             }
         }
     }
+    return count;
 }
 
-bool Engine::newSkinList()
+template <int D>
+bool Engine<D>::newSkinList()
 // Compare the two largest particle displacements to see if a skin refresh is required.
 // Refresh=true if any particle may have entered any other particle's neighborhood.
 {
+    // The displacements were measured in the last step's update, relative to the center of mass
+    // before that step. Against the current one they may be off by up to comStep.
+    
     bool refresh = false;
-    double largest2 = 0.;
-    double second2 = 0.;
-    for(int i=0; i<N; i++){
-        double d2 = 0.0;
-        double dx = delta_norm(cell[i].x[0] - cell[i].x_old[0] - COM[0] + COM_old[0]);
-        double dy = delta_norm(cell[i].x[1] - cell[i].x_old[1] - COM[1] + COM_old[1]);
-		
-		if( NDIM==3 )
-		{
-			double dz = delta_norm(cell[i].x[2] - cell[i].x_old[2] - COM[2] + COM_old[2]);
-			d2 += dz*dz;
-		}
-		
-		d2 += dx*dx+dy*dy;
-		
-        if(d2 > largest2)     { second2 = largest2; largest2 = d2; }
-        else if(d2 > second2) { second2 = d2; }
-    }
+    double first = largest2;
+    double second = second2;
+    domain.largestTwo(first, second);
     
-    if( ( sqrt(largest2)+sqrt(second2) ) > (rs-rn) ){
+    if( ( sqrt(first)+sqrt(second)+2*comStep ) > (rs-rn) ){
         resetCounter++;
         saveOldPositions();
         refresh = true;
@@ -616,260 +1007,328 @@ bool Engine::newSkinList()
     return refresh;
 }
 
-void Engine::neighborInteractions()
+template <int D>
+void Engine<D>::neighborInteractions()
 // *** Most physics happens here *** //
 // Calculate spring repulsion force and neighbor orientational interactions.
+// The boxes are visited colour by colour. Boxes of one colour share no neighboring boxes, so the
+// cells they write to are disjoint and the boxes of a colour can run on separate threads. Each
+// cell receives its contributions in the same order for any number of threads, so a given seed
+// gives the same trajectory on any core count. Grids with b<3 have no colouring and run serially.
 {
-    if(NDIM==2)
+    bool film_ = countdown <= film && t%nSkip == 0;
+    
+    if(clusterKernel) clusters.gather(cell);
+    
+    const vector<vector<int>> &boxColours = topo->boxColours;
+    if(!boxColours.empty())
     {
-        for(int i=0; i<N; i++)
+        for(size_t c=0; c<boxColours.size(); c++)
         {
-            int max = cell[i].VerletList.size();
-            for(int k=0; k<max; k++)                                // Check each cell's Verlet list for neighbors
+            const vector<int> &boxes = boxColours[c];
+            int nboxes = boxes.size();
+            
+            #pragma omp parallel for schedule(dynamic,1) num_threads(threads)
+            for(int m=0; m<nboxes; m++)
             {
-                int j = cell[i].VerletList[k];
-                if(j > i)                                           // Symmetry reduces calculations by half
+                int p = boxes[m];
+                
+                if(clusterKernel)
                 {
-                    double dx = delta_norm(cell[j].x[0]-cell[i].x[0]);
-                    double dy = delta_norm(cell[j].x[1]-cell[i].x[1]);
-                    double d2 = dx*dx+dy*dy;
-                    
-                    if(d2 < rn2)                                    // They're neighbors
-                    {
-                        double sumR = cell[i].R + cell[j].R;
-                    
-                        if( d2 < sumR*sumR )                        // They also overlap
-                        {
-                            double overlap = sumR / sqrt(d2) - 1;
-                                                                    // Spring repulsion force, watch the sign
-							double fx = overlap*dx;
-                        	double fy = overlap*dy;
-							
-                            cell[i].Fx -= fx;
-                            cell[j].Fx += fx;
-                            cell[i].Fy -= fy;
-                            cell[j].Fy += fy;
-                            
-                            if(countdown <= film && t%nSkip == 0){
-                                cell[i].over -= 240*abs(overlap);
-                                cell[j].over -= 240*abs(overlap);
-                            }
-                        }
-                    
-                        cell[i].x_new += cell[j].cosp;                  // Add up orientations of neighbors
-                        cell[i].y_new += cell[j].sinp;
-                        cell[j].x_new += cell[i].cosp;
-                        cell[j].y_new += cell[i].sinp;
-                    }
+                    for(int ci=clusters.boxStart[p]; ci<clusters.boxStart[p+1]; ci++)
+                        clusters.interactions(ci, L, rn2, film_);
+                    continue;
+                }
+                
+                int max = boxCells.size(p);
+                int *inBox = boxCells.cells(p);
+                for(int n=0; n<max; n++)
+                {
+                    int i = inBox[n];
+                    for(int k=cell.verletStart[i]; k<cell.verletStart[i+1]; k++)  // Check each cell's Verlet list for neighbors
+                        pairInteraction(i, cell.verletList[k], film_);             // Each pair is listed once
                 }
             }
-			
-            cell[i].phi   = atan2(cell[i].y_new, cell[i].x_new) + CTnoise*randuni();
+        }
+    }
+    else if(clusterKernel)
+    {
+        for(int ci=0; ci<clusters.nclusters; ci++) clusters.interactions(ci, L, rn2, film_);
+    }
+    else
+    {
+        for(int i=0; i<cell.N; i++)
+        {
+            for(int k=cell.verletStart[i]; k<cell.verletStart[i+1]; k++)
+                pairInteraction(i, cell.verletList[k], film_);
         }
     }
     
-    else if(NDIM==3)
+    if(clusterKernel) clusters.scatter(cell, film_);
+    
+    updateOrientations();
+}
+
+template <int D>
+inline void Engine<D>::pairInteraction(int i, int j, bool film_)
+// Spring repulsion between two cells, and each cell's orientation added to the other's neighborhood
+// sum. Updates both cells (Newton's third law).
+{
+    double dx[D];
+    double d2 = 0.0;
+    for(int k=0; k<D; k++)
     {
-        for(int i=0; i<N; i++)
+        dx[k] = delta_norm(cell.x[k][j]-cell.x[k][i]);
+        d2 += dx[k]*dx[k];
+    }
+    
+    if(d2 < rn2)                                                    // They're neighbors
+    {
+        double sumR = cell.R[i] + cell.R[j];
+        
+        if( d2 < sumR*sumR )                                        // They also overlap
         {
-            int max = cell[i].VerletList.size();
-            for(int k=0; k<max; k++)
+            double overlap = sumR / sqrt(d2) - 1;
+            
+            for(int k=0; k<D; k++)                                  // Spring repulsion force, watch the sign
             {
-                int j = cell[i].VerletList[k];
-                if(j > i)
-                {
-                    double dx = delta_norm(cell[j].x[0]-cell[i].x[0]);
-                    double dy = delta_norm(cell[j].x[1]-cell[i].x[1]);
-                    double dz = delta_norm(cell[j].x[2]-cell[i].x[2]);
-                    double d2 = dx*dx+dy*dy+dz*dz;
-                    
-                    if(d2 < rn2)
-                    {
-                        double sumR = cell[i].R + cell[j].R;
-                        
-                        if( d2 < sumR*sumR )
-                        {
-                            double overlap = sumR / sqrt(d2) - 1;
-							
-                            double fx = overlap*dx;
-                        	double fy = overlap*dy;
-                        	double fz = overlap*dz;
-                            
-                            cell[i].Fx -= fx;
-                            cell[j].Fx += fx;
-                            cell[i].Fy -= fy;
-                            cell[j].Fy += fy;
-                            cell[i].Fz -= fz;
-                            cell[j].Fz += fz;
-                            
-                            if(countdown <= film && t%nSkip == 0)
-                            {
-                                cell[i].over -= 240*abs(overlap);
-                                cell[j].over -= 240*abs(overlap);
-                            }
-                        }
-                        
-                        cell[i].x_new += cell[j].sint*cell[j].cosp;
-                        cell[i].y_new += cell[j].sint*cell[j].sinp;
-                        cell[i].z_new += cell[j].cost;
-
-                        cell[j].x_new += cell[i].sint*cell[i].cosp;
-                        cell[j].y_new += cell[i].sint*cell[i].sinp;
-                        cell[j].z_new += cell[i].cost;
-                    }
-                }
+                double f = overlap*dx[k];
+                cell.F[k][i] -= f;
+                cell.F[k][j] += f;
             }
             
-            double norm = sqrt(  cell[i].x_new*cell[i].x_new
-                               + cell[i].y_new*cell[i].y_new
-                               + cell[i].z_new*cell[i].z_new ) ;
-            
-            // New cell orientation, without noise
-            cell[i].x_new /= norm;
-            cell[i].y_new /= norm;
-            cell[i].z_new /= norm;
-            
-            // Random vector v within a spherical cap around z-axis, defined by CTnoise
-            double phi = randuni();
-            double vz = random_projection(cos(CTnoise*PI));
-            double vy = cos(phi)*sqrt(1.0-vz*vz);
-            double vx = sin(phi)*sqrt(1.0-vz*vz);
-            
-            // Rotation axis from cross product: (0,0,1) x new cell orientation
-            double kx = -cell[i].y_new;
-            double ky = cell[i].x_new;
-            double crossnorm = sqrt(kx*kx+ky*ky);
-            kx /= crossnorm;
-            ky /= crossnorm;
-            
-            // Rotation angle given by dot product: cos(angle) = new_vector . (0,0,1)
-            double cosa = cell[i].z_new;
-            double sina = sin(acos(cell[i].z_new));
-            
-            // Apply Rodrigues rotation formula
-            double dot = (1.0-cosa)*(kx*vx+ky*vy);
-            cell[i].x_new = cosa*vx + sina*ky*vz + dot*kx;
-            cell[i].y_new = cosa*vy - sina*kx*vz + dot*ky;
-            cell[i].z_new = cosa*vz + sina*(kx*vy-ky*vx);
-            
-            cell[i].phi = atan2(cell[i].y_new, cell[i].x_new);
-            cell[i].theta = acos(cell[i].z_new);
+            if(film_)
+            {
+                cell.over[i] -= 240*abs(overlap);
+                cell.over[j] -= 240*abs(overlap);
+            }
+        }
+        
+        for(int k=0; k<D; k++)                                      // Add up orientations of neighbors
+        {
+            cell.u_new[k][i] += cell.u[k][j];
+            cell.u_new[k][j] += cell.u[k][i];
         }
     }
 }
 
-void Engine::calculate_COM()
+template <int D>
+void Engine<D>::updateOrientations()
+// Align each cell with its neighborhood, then add noise. The noise of a cell depends only on the
+// seed, the cell's original number and the step, so the cells can be updated in any order.
+// Orientations stay unit vectors throughout: the noise is a rotation of the normalised
+// neighborhood direction n, with no conversion to angles and back.
 {
-    for(int k=0; k<NDIM; k++)
+    if constexpr (D==2)
     {
-        COM[k] = 0.0;
+        // Rotate n by an angle drawn uniformly from [-CTnoise*PI, CTnoise*PI).
         
-        for(int i=0; i<N; i++)
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for(int i=0; i<cell.N; i++)
         {
-            COM[k] += cell[i].x_real[k];
+            double nx = cell.u_new[0][i];
+            double ny = cell.u_new[1][i];
+            double norm = sqrt(nx*nx + ny*ny);
+            if(norm > 0) { nx /= norm; ny /= norm; }
+            else         { nx = 1.0;   ny = 0.0;  }               // Same as atan2(0,0) = 0
+            
+            double eta = CTnoise*rng.uniform(Random::noise, cell.index[i], noiseStep, -PI, PI);
+            double ce = cos(eta);
+            double se = sin(eta);
+            
+            cell.u[0][i] = ce*nx - se*ny;
+            cell.u[1][i] = se*nx + ce*ny;
         }
-		
-        COM[k] /= N;
     }
-}
-
-double Engine::calculateOrderParameter()
-{
-    vector<double> orient(3,0.0);
     
-    for (int i=0; i<N; i++)
+    if constexpr (D==3)
     {
-    	double inverseVel = 1.0/cell[i].get_speed();
-        orient[0] += cell[i].vx*inverseVel;
-        orient[1] += cell[i].vy*inverseVel;
-        if(NDIM==3) orient[2] += cell[i].vz*inverseVel;
+        // Draw a vector v uniformly from the spherical cap around the z-axis given by CTnoise, and
+        // apply the rotation that takes the z-axis to n. This is the Rodrigues rotation about
+        // z x n, written out so that it needs no trigonometry: with c = n_z, the rotation angle
+        // has cos = c and sin = sqrt(1-c^2), and (1-cos)/sin^2 = 1/(1+c).
+        
+        double capz = cos(CTnoise*PI);
+        
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for(int i=0; i<cell.N; i++)
+        {
+            double nx = cell.u_new[0][i];
+            double ny = cell.u_new[1][i];
+            double nz = cell.u_new[2][i];
+            double norm = sqrt(nx*nx + ny*ny + nz*nz);
+            nx /= norm;
+            ny /= norm;
+            nz /= norm;
+            
+            double u1, u2;
+            rng.uniforms(Random::noise, cell.index[i], noiseStep, u1, u2);
+            double phi = -PI + PI2*u1;
+            double vz = capz + (1.0-capz)*u2;
+            double vy = cos(phi)*sqrt(1.0-vz*vz);
+            double vx = sin(phi)*sqrt(1.0-vz*vz);
+            
+            if(nz > -1.0 + 1e-12)
+            {
+                double w = (nx*vy - ny*vx)/(1.0 + nz);
+                cell.u[0][i] = nz*vx + nx*vz - ny*w;
+                cell.u[1][i] = nz*vy + ny*vz + nx*w;
+                cell.u[2][i] = nz*vz - nx*vx - ny*vy;
+            }
+            else                                                    // n = -z: rotate by PI about x
+            {
+                cell.u[0][i] = vx;
+                cell.u[1][i] = -vy;
+                cell.u[2][i] = -vz;
+            }
+        }
     }
-   
-    return sqrt(orient[0]*orient[0]+orient[1]*orient[1]+orient[2]*orient[2])/(double)N;
+    
+    noiseStep++;
 }
 
-vector<double> Engine::calculateSystemOrientation()
+template <int D>
+void Engine<D>::setOrientation(int i, double phi, double theta)
+// Orientation from its angle in the x-y plane and, in 3D, its angle from the z-axis.
 {
-   	vector<double> orient(3,0.0);
-	
-    for (int i=0; i<N; i++)
+    if constexpr (D==2)
     {
-    	double inverseVel = 1.0/cell[i].get_speed();
-        orient[0] += cell[i].vx*inverseVel;
-        orient[1] += cell[i].vy*inverseVel;
-        if(NDIM==3) orient[2] += cell[i].vz*inverseVel;
+        cell.u[0][i] = cos(phi);
+        cell.u[1][i] = sin(phi);
     }
     
-    for (int k=0; k<NDIM; k++ ) orient[k] /= (double)N;
-    
-    return orient;
-}
-
-double Engine::MSD()
-{
-    double MSD = 0.0;
-    for (int i=0; i<N; i++)
+    if constexpr (D==3)
     {
-    	double dx = cell[i].x_real[0] - cell[i].x0[0] - COM[0] + COM0[0];
-    	double dy = cell[i].x_real[1] - cell[i].x0[1] - COM[1] + COM0[1];
-    	double dz = 0.0;
-		if( NDIM==3 )
-		{
-			dz = cell[i].x_real[2] - cell[i].x0[2] - COM[2] + COM0[2];
-		}
-		MSD += dx*dx+dy*dy+dz*dz;
+        cell.u[0][i] = sin(theta)*cos(phi);
+        cell.u[1][i] = sin(theta)*sin(phi);
+        cell.u[2][i] = cos(theta);
     }
-    return MSD/N;
 }
 
-void Engine::saveOldPositions()
+template <int D>
+void Engine<D>::calculate_COM()
 {
-    for(int k=0; k<NDIM; k++)
+    for(int k=0; k<D; k++)
     {
-        COM_old[k] = COM[k];
-        for(int i=0; i<N; i++)
+        COM[k] = 0.0;
+        
+        for(int i=0; i<cell.N; i++)
+        {
+            COM[k] += cell.x_real[k][i];
+        }
+    }
+    
+    globalSum(COM.data(), D);
+    for(int k=0; k<D; k++) COM[k] /= N;
+}
+
+template <int D>
+Observables<D>& Engine<D>::observe(bool msd)
+// The observables of the current step. They are measured at most once per step, the first time
+// they are asked for; the MSD only if asked for.
+{
+    if( !observables.current(t, msd) ) observables.measure(cell, t, N, COM, COM0, msd, threads);
+    return observables;
+}
+
+template <int D>
+void Engine<D>::saveOldPositions()
+{
+    for(int k=0; k<D; k++)
+    {
+        COM_old[k] = COM[k];
+        for(int i=0; i<cell.N; i++)
         {
-            cell[i].x_old[k]  = cell[i].x[k];
+            cell.x_old[k][i]  = cell.x[k][i];
         }
     }
+    largest2 = second2 = comStep = 0.0;
 }
 
-void Engine::calculate_next_positions()
+template <int D>
+void Engine<D>::calculate_next_positions()
+// A new skin radius from the tuner takes effect at the next refresh, when the lists are rebuilt
+// with it. A thinner skin can start at once: the lists are then longer than needed, and the
+// stricter refresh test brings the next refresh forward.
 {
+    high_resolution_clock::time_point t0 = high_resolution_clock::now();
+    
+    if( tuneSkin && skinTuner.ready() ) rsNext = skinTuner.next(rs, rn, rsMin, rsMax, D);
+    if( rsNext < rs ) setSkin(rsNext);
+    
     if( newSkinList() )
     {
-        assignCellsToGrid();
-        buildVerletLists();
+        setSkin(rsNext);
+        refreshNeighbors( reorderInterval > 0 && resetCounter%reorderInterval == 0 );
+        skinTuner.addRefresh(duration_cast<duration<double>>(high_resolution_clock::now() - t0).count());
     }
+    else
+    {
+        domain.updateGhosts(cell);
+    }
+    
+    high_resolution_clock::time_point t1 = high_resolution_clock::now();
     
     neighborInteractions();
     
-    for(int i=0; i<N; i++)
+    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    
+    // One sweep integrates, applies periodic boundaries, adds up the center of mass and finds the
+    // displacements for the next list check.
+    
+    std::array<double, D> shift, sum;
+    for(int k=0; k<D; k++) shift[k] = COM[k] - COM_old[k];
+    
+    cell.update(CFself, shift, sum, largest2, second2);
+    
+    globalSum(sum.data(), D);
+    double step2 = 0.0;
+    for(int k=0; k<D; k++)
     {
-        cell[i].update(CFself);
+        double c = sum[k]/N;
+        step2 += (c - COM[k])*(c - COM[k]);
+        COM[k] = c;
     }
+    comStep = sqrt(step2);
     
-    calculate_COM();
+    high_resolution_clock::time_point t3 = high_resolution_clock::now();
+    skinTuner.addStep(duration_cast<duration<double>>(t2 - t1).count(),
+                      duration_cast<duration<double>>(t3 - t0).count());
+}
+
+template <int D>
+void Engine<D>::setSkin(double r)
+{
+    rs = r;
+    rs2 = r*r;
 }
 
-void Engine::print_video(Print &printer)
+template <int D>
+void Engine<D>::print_video(Print<D> &printer)
+// Cells are written by their original index, whatever order they are currently stored in.
 {
-    int k=0;
+    vector<double> R(N);
+    vector<vector<double>> x(D, vector<double>(N)), velocity(D, vector<double>(N));
+    vector<int> over(N);
+    
     for(int i=0; i<N; i++)
     {
-    	vector<double> velocity(3,0.0);
-		
-    	velocity[0] = cell[i].vx;
-    	velocity[1] = cell[i].vy;
-    	velocity[2] = cell[i].vz;
-		
-        printer.print_Ovito(k, N, i, cell[i].R, cell[i].over, cell[i].x, velocity);
-        cell[i].over = 240;
-        k=1;
+        int id = cell.index[i];
+        R[id] = cell.R[i];
+        over[id] = cell.over[i];
+        for(int m=0; m<D; m++)
+        {
+            x[m][id] = cell.x[m][i];
+            velocity[m][id] = cell.v[m][i];
+        }
+        cell.over[i] = 240;
     }
+    
+    printer.print_frame(t, L, R, x, velocity, over);
 }
 
-double Engine::delta_norm(double delta)
+template <int D>
+double Engine<D>::delta_norm(double delta)
 // Subtracts multiples of the box size to account for periodic boundary conditions
 {
     int k=-1;
@@ -879,15 +1338,692 @@ double Engine::delta_norm(double delta)
     return delta;
 }
 
-double Engine::random_projection(double cost)
+template <int D>
+string Engine<D>::checkpointFile(Print<D> &printer)
+// In the run's folder. Every process of a decomposed run keeps its own.
+{
+    string file = printer.path+run+"/checkpoint";
+    if(domain.size > 1) file += "."+to_string(domain.rank);
+    return file+".bin";
+}
+
+template <int D>
+bool Engine<D>::stopRequested(long int step, Print<D> &printer, Fluctuations<D> &fluct, Correlations<D> &corr)
+// True once a signal asked the run to stop. It is looked at every nSkip steps, together by all
+// processes, so that they stop at the same step. With checkpoints on, one more is written, so
+// that --restart carries on from here.
+{
+    if(step%nSkip != 0) return false;
+    if(globalSum(stopSignal ? 1.0 : 0.0) == 0.0) return false;
+    
+    if(checkpointInterval > 0) writeCheckpoint(printer, fluct, corr);
+    if(domain.rank == 0) cout << "Run " << run << " stopped by a signal at step " << step << (relaxed ? "" : " of the relaxation") << endl;
+    stopped = true;
+    return true;
+}
+
+template <int D>
+void Engine<D>::writeCheckpoint(Print<D> &printer, Fluctuations<D> &fluct, Correlations<D> &corr)
+// Everything that the rest of the run depends on, between two steps. The grid and the stencils
+// follow from the parameters and are set up again on restart; the boxes of the cells and the
+// Verlet lists are stored, so that the restarted run sums the forces in the same order.
+{
+    Checkpoint file;
+    file.create(checkpointFile(printer));
+    
+    const uint64_t magic = 0x314b48434d414aULL;     // "JAMCHK1"
+    file.put(magic);
+    file.put(D);
+    file.put(N);
+    file.put(domain.size);
+    file.put(totalSteps);
+    file.put(CTnoise);
+    file.put(dens);
+    file.put(clusterKernel);
+    file.put(rng.seed);
+    
+    file.put(t);
+    file.put(countdown);
+    file.put(resetCounter);
+    file.put(noiseStep);
+    file.put(relaxStep);
+    file.put(relaxed);
+    file.put(corrCounter);
+    
+    file.put(COM);
+    file.put(COM0);
+    file.put(COM_old);
+    file.put(largest2);
+    file.put(second2);
+    file.put(comStep);
+    file.put(orderAvg);
+    file.put(order2Avg);
+    file.put(order4Avg);
+    file.put(rs);
+    file.put(rsNext);
+    file.put(elapsed + duration_cast<duration<double>>(high_resolution_clock::now() - startTime).count());
+    
+    cell.save(file);
+    file.put(boxCells.start);
+    file.put(boxCells.index);
+    file.put(domain.sendBelow);
+    file.put(domain.sendAbove);
+    file.put(domain.ghostsBelow);
+    file.put(domain.ghostsAbove);
+    if(clusterKernel) clusters.save(file);
+    
+    skinTuner.save(file);
+    fluct.save(file);
+    corr.save(file);
+    file.put(printer.sizes());
+    
+    file.commit();
+}
+
+template <int D>
+void Engine<D>::readHeader(Checkpoint &file)
+// The checkpoint must come from a run with the same parameters. Its seed replaces ours.
+{
+    uint64_t magic;
+    int dim, size;
+    int n;
+    long int steps;
+    double noise, rho;
+    bool cluster;
+    
+    file.get(magic);
+    file.get(dim);
+    file.get(n);
+    file.get(size);
+    file.get(steps);
+    file.get(noise);
+    file.get(rho);
+    file.get(cluster);
+    file.get(rng.seed);
+    
+    if(magic != 0x314b48434d414aULL || dim != D || n != N || size != domain.size || steps != totalSteps
+       || noise != CTnoise || rho != dens || cluster != clusterKernel)
+    {
+        if(domain.rank == 0) cout << "Checkpoint " << file.file << " is not from a run with these parameters"
+                                  << " and processes. Status 734\n";
+        exit(734);
+    }
+}
+
+template <int D>
+void Engine<D>::readCheckpoint(Checkpoint &file, Print<D> &printer, Fluctuations<D> &fluct, Correlations<D> &corr)
+// The rest of the checkpoint, after readHeader, initCells and topology.
+{
+    file.get(t);
+    file.get(countdown);
+    file.get(resetCounter);
+    file.get(noiseStep);
+    file.get(relaxStep);
+    file.get(relaxed);
+    file.get(corrCounter);
+    
+    file.get(COM);
+    file.get(COM0);
+    file.get(COM_old);
+    file.get(largest2);
+    file.get(second2);
+    file.get(comStep);
+    file.get(orderAvg);
+    file.get(order2Avg);
+    file.get(order4Avg);
+    file.get(rs);
+    file.get(rsNext);
+    file.get(elapsed);
+    setSkin(rs);
+    
+    cell.load(file);
+    file.get(boxCells.start);
+    file.get(boxCells.index);
+    file.get(domain.sendBelow);
+    file.get(domain.sendAbove);
+    file.get(domain.ghostsBelow);
+    file.get(domain.ghostsAbove);
+    if(clusterKernel) clusters.load(file);
+    
+    skinTuner.load(file);
+    fluct.load(file);
+    corr.load(file);
+    
+    vector<long int> sizes;
+    file.get(sizes);
+    printer.resume(sizes);
+}
+
+template <int D>
+string Engine<D>::relaxedFile(int trelax)
+// One file per number of cells, density, dimension, seed, radius distribution and length of the
+// passive phase
 {
-    boost::uniform_real<> dist(cost, 1);
-    boost::variate_generator<boost::mt19937&, boost::uniform_real<> > z_project(gen, dist);
-    return z_project();
+    return relaxCache+"/relaxed_"+to_string(D)+"D_N"+to_string(N)+"_rho"+to_string(dens)+"_seed"
+           +to_string(rng.seed)+"_"+radiusDistribution+"_steps"+to_string(trelax)+".bin";
+}
+
+template <int D>
+bool Engine<D>::readRelaxed(int trelax)
+// Set the cells up from the cached positions after the passive phase, if there are any, as
+// initCells does from the lattice. The orientations are drawn as for one more passive step,
+// because the ones at the end of the passive phase depend on the noise.
+{
+    string name = relaxedFile(trelax);
+    if(!ifstream(name.c_str()).good()) return false;
+    
+    Checkpoint file;
+    file.open(name);
+    
+    vector<double> R;
+    std::array<vector<double>, D> x;
+    file.get(R);
+    for(int k=0; k<D; k++) file.get(x[k]);
+    if(R.size() != (size_t)N) return false;
+    
+    vector<int> own;
+    for (int i=0; i<N; i++) {
+        if( domain.size == 1 || domain.owns(x[D-1][i]) ) own.push_back(i);
+    }
+    
+    cell.resize(own.size(), dt);
+    
+    for (int n=0; n<cell.N; n++) {
+        
+        int i = own[n];
+        cell.index[n] = i;
+        cell.R[n]  = R[i];
+        cell.Rinv[n] = 1.0/R[i];
+        for (int k=0; k<D; k++) cell.x[k][n] = cell.x_real[k][n] = x[k][i];
+        
+        double u1, u2;
+        rng.uniforms(Random::relax, i, trelax, u1, u2);
+        setOrientation(n, -PI + PI2*u1, PI*u2);
+    }
+    
+    noiseStep = trelax;
+    resetCounter = 0;
+    refreshNeighbors(true);
+    calculate_COM();
+    saveOldPositions();
+    
+    return true;
+}
+
+template <int D>
+void Engine<D>::writeRelaxed(int trelax)
+// Radii and positions of all cells in their original order, written by process 0.
+{
+    vector<double> R(N);
+    std::array<vector<double>, D> x;
+    for(int k=0; k<D; k++) x[k].resize(N);
+    
+    if(domain.size == 1)
+    {
+        for(int n=0; n<cell.N; n++)
+        {
+            R[cell.index[n]] = cell.R[n];
+            for(int k=0; k<D; k++) x[k][cell.index[n]] = cell.x[k][n];
+        }
+    }
+    else
+    {
+        Cells<D> all;
+        domain.gather(cell, all);
+        if(domain.rank == 0)
+        {
+            R.assign(all.R.begin(), all.R.end());
+            for(int k=0; k<D; k++) x[k].assign(all.x[k].begin(), all.x[k].end());
+        }
+    }
+    
+    if(domain.rank == 0)
+    {
+        if(system(("mkdir -p "+relaxCache).c_str()) < 0) cout << "Cannot create " << relaxCache << endl;
+        
+        Checkpoint file;
+        file.create(relaxedFile(trelax));
+        file.put(R);
+        for(int k=0; k<D; k++) file.put(x[k]);
+        file.commit();
+    }
+    
+    // The other processes read the file right after, so they wait for process 0 to finish it.
+    
+    uint64_t done = 1;
+    domain.broadcast(done);
+}
+
+template <int D>
+void benchmarkRefresh(int threads)
+// Time the two halves of a Verlet list refresh, binning and list building, on the initial
+// lattice at rho = 1 for increasing numbers of cells. List building uses the given threads.
+{
+    cout << "N\tboxes\tbinning (ms)\tlist build (ms)\tlist memory (MB)" << endl;
+    
+    for(long int n=1000; n<=1000000; n*=10)
+    {
+        Engine<D> engine("benchmark", "refresh", n, 0, 0.0, 0.0, 1.0);
+        engine.threads = threads;
+        engine.initCells();
+        engine.topology();
+        
+        int reps = max(1, (int)(1e5/n));
+        
+        high_resolution_clock::time_point t1 = high_resolution_clock::now();
+        for(int r=0; r<reps; r++) engine.assignCellsToGrid();
+        high_resolution_clock::time_point t2 = high_resolution_clock::now();
+        for(int r=0; r<reps; r++) engine.buildVerletLists();
+        high_resolution_clock::time_point t3 = high_resolution_clock::now();
+        
+        double binning = duration_cast<duration<double, milli>>(t2 - t1).count()/reps;
+        double build   = duration_cast<duration<double, milli>>(t3 - t2).count()/reps;
+        
+        double memory = (engine.cell.verletStart.capacity() + engine.cell.verletList.capacity())*sizeof(int)/1e6;
+        
+        cout << n << "\t" << engine.nbox << "\t" << binning << "\t" << build << "\t" << memory << endl;
+    }
+}
+
+template <int D>
+void benchmarkThreads(int maxThreads)
+// Strong scaling of the force loop: time neighborInteractions on the initial lattice at rho = 1
+// for 1, 2, 4, ... up to maxThreads threads, with N from 10^4 to 10^6.
+{
+    cout << "N\tthreads\tforces (ms)\tspeedup" << endl;
+    
+    for(long int n=10000; n<=1000000; n*=10)
+    {
+        Engine<D> engine("benchmark", "threads", n, 0, 0.0, 0.5, 1.0);
+        engine.initCells();
+        engine.topology();
+        engine.assignCellsToGrid();
+        engine.reorderCells();
+        engine.buildVerletLists();
+        
+        int reps = max(1, (int)(1e6/n));
+        double serial = 0.0;
+        
+        for(int th=1; th<=maxThreads; th = (th==maxThreads) ? th+1 : min(2*th, maxThreads))
+        {
+            engine.threads = th;
+            
+            high_resolution_clock::time_point t1 = high_resolution_clock::now();
+            for(int r=0; r<reps; r++) engine.neighborInteractions();
+            high_resolution_clock::time_point t2 = high_resolution_clock::now();
+            
+            double forces = duration_cast<duration<double, milli>>(t2 - t1).count()/reps;
+            if(th == 1) serial = forces;
+            
+            cout << n << "\t" << th << "\t" << forces << "\t" << serial/forces << endl;
+        }
+    }
+}
+
+template <int D>
+void benchmarkSteps(int threads)
+// Steps per second of the whole time step, from the initial lattice at rho = 1 with
+// self-propulsion 0.3, split into the force loop, list refreshes and the rest (mainly the
+// update of the positions). Forces and refreshes use the given threads.
+{
+    cout << "N\tsteps/s\tforces (ms)\trefreshes (ms)\trest (ms)" << endl;
+    
+    for(long int n=10000; n<=1000000; n*=10)
+    {
+        Engine<D> engine("benchmark", "steps", n, 0, 0.3, 0.5, 1.0);
+        engine.threads = threads;
+        engine.initCells();
+        engine.topology();
+        engine.refreshNeighbors(false);
+        
+        for(int k=0; k<D; k++) engine.cell.x_real[k] = engine.cell.x[k];
+        engine.calculate_COM();
+        engine.saveOldPositions();
+        
+        int reps = max(10, (int)(1e7/n));
+        for(int r=0; r<reps; r++) engine.calculate_next_positions();
+        
+        SkinTuner &timer = engine.skinTuner;
+        double step    = 1e3*timer.stepTime/timer.steps;
+        double forces  = 1e3*timer.forceTime/timer.steps;
+        double refresh = 1e3*timer.refreshTime/timer.steps;
+        
+        cout << n << "\t" << 1e3/step << "\t" << forces << "\t" << refresh << "\t" << step - forces - refresh << endl;
+    }
+}
+
+template <int D>
+void benchmarkKernel()
+// Time one force evaluation with the pair kernel and with the cluster-pair kernel, on the
+// initial lattice at rho = 1.
+{
+    if(!clusterVectorised) cout << "Built without AVX, so the cluster kernel runs on scalar code" << endl;
+    cout << "N\tpair (ms)\tcluster (ms)\tspeedup" << endl;
+    
+    for(long int n=10000; n<=1000000; n*=10)
+    {
+        Engine<D> engine("benchmark", "kernel", n, 0, 0.0, 0.5, 1.0);
+        engine.initCells();
+        engine.topology();
+        engine.assignCellsToGrid();
+        engine.reorderCells();
+        engine.clusterKernel = true;
+        engine.buildVerletLists();
+        
+        int reps = max(1, (int)(1e6/n));
+        double time[2];
+        
+        for(int kernel=0; kernel<2; kernel++)
+        {
+            engine.clusterKernel = (kernel == 1);
+            
+            high_resolution_clock::time_point t1 = high_resolution_clock::now();
+            for(int r=0; r<reps; r++) engine.neighborInteractions();
+            high_resolution_clock::time_point t2 = high_resolution_clock::now();
+            
+            time[kernel] = duration_cast<duration<double, milli>>(t2 - t1).count()/reps;
+        }
+        
+        cout << n << "\t" << time[0] << "\t" << time[1] << "\t" << time[0]/time[1] << endl;
+    }
+}
+
+template <int D>
+void benchmarkCorrelations(int threads)
+// Time one sample of the spatial correlations as sums over pairs, with the given number of
+// threads, and from FFTs on a mesh, on the initial lattice at rho = 1 with the cutoff of remote
+// runs.
+{
+    cout << "N\tpairs (ms)\tmesh (ms)\tspeedup" << endl;
+    
+    for(long int n=1000; n<=100000; n*=10)
+    {
+        Engine<D> engine("benchmark", "correlations", n, 0, 0.0, 0.5, 1.0);
+        if constexpr (D==2) engine.cutoff = 140;
+        if constexpr (D==3) engine.cutoff = 70;
+        engine.initCells();
+        engine.topology();
+        engine.assignCellsToGrid();
+        for(int k=0; k<D; k++) engine.cell.v[k] = engine.cell.u[k];
+        
+        Correlations<D> corr(engine.L, engine.dens, engine.cutoff, engine.tCorrelation, engine.N, 0.5);
+        corr.threads = threads;
+        double time[2];
+        
+        for(int mesh=0; mesh<2; mesh++)
+        {
+            corr.mesh = (mesh == 1);
+            
+            high_resolution_clock::time_point t1 = high_resolution_clock::now();
+            corr.spatialCorrelations(engine.topo->boxPairs, engine.boxCells, engine.cell);
+            high_resolution_clock::time_point t2 = high_resolution_clock::now();
+            
+            time[mesh] = duration_cast<duration<double, milli>>(t2 - t1).count();
+        }
+        
+        cout << n << "\t" << time[0] << "\t" << time[1] << "\t" << time[0]/time[1] << endl;
+    }
+}
+
+template <int D>
+void benchmarkFluctuations(int threads)
+// Time the volumes measured per second around the center of mass, one radius at a time, and on
+// the box grid, at many radii and centres, on the initial lattice at rho = 1.
+{
+    cout << "N\tCOM (volumes/s)\tgrid (volumes/s)\tspeedup" << endl;
+    
+    for(long int n=1000; n<=100000; n*=10)
+    {
+        Engine<D> engine("benchmark", "fluctuations", n, 0, 0.0, 0.5, 1.0);
+        engine.initCells();
+        engine.topology();
+        for(int k=0; k<D; k++) engine.cell.x_real[k] = engine.cell.x[k];
+        
+        Print<D> printer("", "benchmark", "fluctuations", n, false, false, false);
+        Fluctuations<D> fluct(engine.L, 100, 1, engine.dens);
+        fluct.threads = threads;
+        fluct.setupGrid(engine.b, engine.lp);
+        double rate[2];
+        
+        int repeats = (int)max(1L, 1000000/n);
+        high_resolution_clock::time_point t1 = high_resolution_clock::now();
+        for(int r=0; r<repeats; r++) fluct.measureFluctuations(engine.cell, engine.COM, printer);
+        high_resolution_clock::time_point t2 = high_resolution_clock::now();
+        rate[0] = repeats/duration_cast<duration<double>>(t2 - t1).count();
+        
+        repeats = (int)max(1L, 100000/n);
+        t1 = high_resolution_clock::now();
+        for(int r=0; r<repeats; r++) fluct.measureGrid(engine.cell, engine.rng, r);
+        t2 = high_resolution_clock::now();
+        rate[1] = (double)repeats*fluct.gridCentres*fluct.gridRadii/duration_cast<duration<double>>(t2 - t1).count();
+        
+        cout << n << "\t" << rate[0] << "\t" << rate[1] << "\t" << rate[1]/rate[0] << endl;
+    }
+}
+
+struct Options
+// Optional "--name value" arguments, given after the positional ones
+{
+    int dim = 3;                        // Number of dimensions, 2 or 3
+    int threads = 1;                    // OpenMP threads for the force loop
+    string kernel = "pair";             // Force loop: "pair" or "cluster"
+    bool seeded = false;                // Seed given, otherwise taken from the clock
+    uint64_t seed = 0;
+    double skin = 1.5;                  // Verlet skin radius in units of rn
+    bool tuneSkin = false;              // "--skin auto": tune the skin radius during the run
+    long int checkpoint = 0;            // Steps between checkpoints, 0 for none
+    bool restart = false;               // "--restart", without a value: carry on from the last checkpoint
+    string relaxCache = "";             // Folder for the cache of relaxed passive configurations
+    string series = "text";             // Time series of COM, orientation, order and MSD: "text" or "binary"
+    string correlations = "pairs";      // Spatial correlations: "pairs" or "mesh"
+    string multiTau = "none";           // Multi-tau autocorrelations: "none", "orientation" or "all"
+    string fluctuations = "com";        // Number fluctuations: "com" or "grid"
+    int msdSamples = 0;                 // Positions kept for the MSD over all time origins, 0 for none
+    int workers = 0;                    // Runs at once in a sweep, 0 for one per core and thread
+    
+    bool parse(int, int, char**);
+};
+
+bool Options::parse(int first, int argc, char *argv[])
+{
+    for(int a=first; a<argc; a+=2)
+    {
+        string flag = argv[a];
+        if(flag == "--restart")
+        {
+            restart = true;
+            a--;                        // Takes no value
+            continue;
+        }
+        if(a+1 == argc)
+        {
+            cout << "Missing value for option " << flag << endl;
+            return false;
+        }
+        
+        if(flag == "--dim") dim = atoi(argv[a+1]);
+        else if(flag == "--threads") threads = atoi(argv[a+1]);
+        else if(flag == "--kernel") kernel = argv[a+1];
+        else if(flag == "--checkpoint") checkpoint = atol(argv[a+1]);
+        else if(flag == "--relax-cache") relaxCache = argv[a+1];
+        else if(flag == "--workers") workers = atoi(argv[a+1]);
+        else if(flag == "--series") series = argv[a+1];
+        else if(flag == "--correlations") correlations = argv[a+1];
+        else if(flag == "--multitau") multiTau = argv[a+1];
+        else if(flag == "--msd-samples") msdSamples = atoi(argv[a+1]);
+        else if(flag == "--fluctuations") fluctuations = argv[a+1];
+        else if(flag == "--skin")
+        {
+            if(string(argv[a+1]) == "auto") tuneSkin = true;
+            else skin = atof(argv[a+1]);
+        }
+        else if(flag == "--seed")
+        {
+            seeded = true;
+            seed = strtoull(argv[a+1], 0, 10);
+        }
+        else
+        {
+            cout << "Unknown option " << flag << endl;
+            return false;
+        }
+    }
+    
+    if(dim != 2 && dim != 3)
+    {
+        cout << "--dim must be 2 or 3" << endl;
+        return false;
+    }
+    if(kernel != "pair" && kernel != "cluster")
+    {
+        cout << "--kernel must be pair or cluster" << endl;
+        return false;
+    }
+    if(kernel == "cluster" && !clusterVectorised)
+    {
+        cout << "--kernel cluster is slower than pair without AVX, build with -march=native or -mavx2" << endl;
+        return false;
+    }
+    if(threads < 1)
+    {
+        cout << "--threads must be at least 1" << endl;
+        return false;
+    }
+    if(series != "text" && series != "binary")
+    {
+        cout << "--series must be text or binary" << endl;
+        return false;
+    }
+    if(correlations != "pairs" && correlations != "mesh")
+    {
+        cout << "--correlations must be pairs or mesh" << endl;
+        return false;
+    }
+    if(multiTau != "none" && multiTau != "orientation" && multiTau != "all")
+    {
+        cout << "--multitau must be none, orientation or all" << endl;
+        return false;
+    }
+    if(msdSamples < 0 || msdSamples%2 != 0)
+    {
+        cout << "--msd-samples must be 0 or an even number" << endl;
+        return false;
+    }
+    if(fluctuations != "com" && fluctuations != "grid")
+    {
+        cout << "--fluctuations must be com or grid" << endl;
+        return false;
+    }
+    if(workers < 0)
+    {
+        cout << "--workers must be 0 or more" << endl;
+        return false;
+    }
+    if(checkpoint < 0)
+    {
+        cout << "--checkpoint must be 0 or more steps" << endl;
+        return false;
+    }
+    if(skin < 1.05 || skin > 2.0)
+    {
+        cout << "--skin must be auto or between 1.05 and 2" << endl;
+        return false;
+    }
+#ifndef _OPENMP
+    if(threads > 1) cout << "Compiled without OpenMP, running on a single thread" << endl;
+#endif
+    return true;
+}
+
+template <int D>
+void run(string dir, string ID, long int n, long int steps, double l_s, double l_n, double rho, Options &options,
+         TopologyCache<D> *topologyCache = 0)
+{
+    Engine<D> engine(dir, ID, n, steps, l_s, l_n, rho);
+    engine.topologyCache = topologyCache;
+    engine.threads = options.threads;
+    engine.clusterKernel = (options.kernel == "cluster");
+    if(options.seeded) engine.rng.seed = options.seed;
+    engine.rs = engine.rsNext = options.skin*engine.rn;
+    engine.rs2 = engine.rs*engine.rs;
+    engine.tuneSkin = options.tuneSkin;
+    engine.checkpointInterval = options.checkpoint;
+    engine.restart = options.restart;
+    engine.relaxCache = options.relaxCache;
+    engine.binarySeries = (options.series == "binary");
+    engine.meshCorrelations = (options.correlations == "mesh");
+    engine.multiTau = options.multiTau;
+    if(engine.multiTau == "all" && engine.domain.size > 1)
+    {
+        if(engine.domain.rank == 0) cout << "The velocity autocorrelation needs all cells in one process, using --multitau orientation" << endl;
+        engine.multiTau = "orientation";
+    }
+    engine.gridFluctuations = (options.fluctuations == "grid");
+    engine.msdSamples = options.msdSamples;
+    if(engine.msdSamples > 0 && engine.domain.size > 1)
+    {
+        if(engine.domain.rank == 0) cout << "The MSD over all time origins needs all cells in one process, leaving it out" << endl;
+        engine.msdSamples = 0;
+    }
+    engine.start();
+}
+
+template <int D>
+void sweep(string file, Options &options)
+// All runs of a sweep file in this process. Runs with the same simulation area, which with a
+// fixed --seed means the same number of cells and density, share their topology.
+{
+    vector<SweepPoint> points = readSweep(file);
+    
+    int workers = options.workers;
+    if(workers == 0) workers = max(1, (int)thread::hardware_concurrency()/options.threads);
+    
+    TopologyCache<D> cache;
+    runSweep(points, workers, [&](SweepPoint &p)
+             { run<D>(p.dir, p.ID, p.n, p.steps, p.l_s, p.l_n, p.rho, options, &cache); });
+}
+
+void convertXYZ(string name, string out, long int first, long int last)
+// Write frames first to last of a binary trajectory in the "XYZ" file format, with the columns
+// index, radius, overlap colour, position and velocity that Ovito is set up for.
+{
+    TrajectoryReader video(name);
+    ofstream xyz(out.c_str());
+    if(!xyz)
+    {
+        cout << "Cannot write " << out << ". Status 743\n";
+        exit(743);
+    }
+    
+    last = min(last, video.frames-1);
+    
+    long int step;
+    vector<vector<double>> x, v;
+    vector<int> over;
+    for(long int k=first; k<=last; k++)
+    {
+        video.read(k, step, x, v, over);
+        
+        xyz << video.N << "\n";
+        xyz << "time step " << step << "\n";
+        for(int i=0; i<video.N; i++)
+        {
+            xyz << i << "\t" << video.R[i] << "\t" << over[i];
+            for(int m=0; m<video.D; m++) xyz << "\t" << x[m][i];
+            for(int m=0; m<video.D; m++) xyz << "\t" << v[m][i];
+            xyz << "\n";
+        }
+    }
+    cout << "Wrote " << max(0L, last-first+1) << " of " << video.frames << " frames to " << out << endl;
 }
 
 int main(int argc, char *argv[])
 {
+#ifdef USE_MPI
+    MPI_Init(&argc, &argv);
+    atexit([]{ MPI_Finalize(); });
+#endif
+    
     string dir = "";
     string ID = "";
     long int n = 0;
@@ -896,9 +2032,74 @@ int main(int argc, char *argv[])
     double l_n = 0;
     double rho = 0;
     
-    int npoints = 0;
+    Options options;
+    
+    // SIGINT and SIGTERM stop runs at the next step that looks, with their files complete
+    
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    
+    if(argc >= 3 && string(argv[1]) == "benchmark")
+    {
+        if(!options.parse(3, argc, argv)) return 1;
+        
+        if(string(argv[2]) == "refresh")
+        {
+            if(options.dim == 2) benchmarkRefresh<2>(options.threads);
+            if(options.dim == 3) benchmarkRefresh<3>(options.threads);
+        }
+        if(string(argv[2]) == "threads")
+        {
+            if(options.dim == 2) benchmarkThreads<2>(options.threads);
+            if(options.dim == 3) benchmarkThreads<3>(options.threads);
+        }
+        if(string(argv[2]) == "steps")
+        {
+            if(options.dim == 2) benchmarkSteps<2>(options.threads);
+            if(options.dim == 3) benchmarkSteps<3>(options.threads);
+        }
+        if(string(argv[2]) == "correlations")
+        {
+            if(options.dim == 2) benchmarkCorrelations<2>(options.threads);
+            if(options.dim == 3) benchmarkCorrelations<3>(options.threads);
+        }
+        if(string(argv[2]) == "fluctuations")
+        {
+            if(options.dim == 2) benchmarkFluctuations<2>(options.threads);
+            if(options.dim == 3) benchmarkFluctuations<3>(options.threads);
+        }
+        if(string(argv[2]) == "kernel")
+        {
+            if(options.dim == 2) benchmarkKernel<2>();
+            if(options.dim == 3) benchmarkKernel<3>();
+        }
+        return 0;
+    }
+    
+    if(argc >= 4 && string(argv[1]) == "xyz")
+    {
+        long int first = argc >= 5 ? atol(argv[4]) : 0;
+        long int last = argc >= 6 ? atol(argv[5]) : (argc == 5 ? first : LONG_MAX);
+        convertXYZ(argv[2], argv[3], max(0L, first), last);
+        return 0;
+    }
+    
+    if(argc >= 3 && string(argv[1]) == "sweep")
+    {
+        if(!options.parse(3, argc, argv)) return 1;
+        
+        Domain<3> domain;
+        if(domain.size > 1)
+        {
+            if(domain.rank == 0) cout << "A sweep runs in one process, start it without mpirun" << endl;
+            return 1;
+        }
+        if(options.dim == 2) sweep<2>(argv[2], options);
+        if(options.dim == 3) sweep<3>(argv[2], options);
+        return stopSignal ? stoppedStatus : 0;
+    }
     
-    if(argc != 8){
+    if(argc < 8 || !options.parse(8, argc, argv)){
         cout    << "Incorrect number of arguments. Need: " << endl
         << "- full run ID" << endl
         << "- single run ID" << endl
@@ -907,7 +2108,36 @@ int main(int argc, char *argv[])
         << "- \\lambda_s" << endl
         << "- \\lambda_n" << endl
         << "- \\rho" << endl
-        << "Program exit status (1)" << endl;
+        << "Optionally followed by:" << endl
+        << "- --dim <2 or 3>, default 3" << endl
+        << "- --threads <n>, default 1" << endl
+        << "- --kernel <pair or cluster>, default pair. cluster needs a build with -march=native or -mavx2" << endl
+        << "- --seed <n>, default taken from the clock" << endl
+        << "- --skin <rs/rn or auto>, Verlet skin radius, default 1.5" << endl
+        << "- --checkpoint <steps>, write a checkpoint every so many steps, default 0 for none" << endl
+        << "- --restart, carry on from the last checkpoint of the run, with the same arguments" << endl
+        << "- --relax-cache <folder>, share the passive relaxation between runs with the same seed" << endl
+        << "- --series <text or binary>, COM, orientation, order and MSD as text or in dat/series.bin, default text" << endl
+        << "- --correlations <pairs or mesh>, spatial correlations from pair sums or from FFTs on a mesh," << endl
+        << "  which also gives the structure factor, default pairs" << endl
+        << "- --multitau <none, orientation or all>, autocorrelation of the orientation, and with all also" << endl
+        << "  the velocity autocorrelation, at every lag up to the run length, default none" << endl
+        << "- --msd-samples <n>, keep n samples of all positions and write the MSD averaged over all time" << endl
+        << "  origins to dat/MSDAveraged.dat, default 0 for none" << endl
+        << "- --fluctuations <com or grid>, number fluctuations around the center of mass, one radius at a" << endl
+        << "  time, or at 32 radii around 64 random centres per sample, using the box grid, default com" << endl
+        << "Built with -DUSE_MPI and started with mpirun -np <p>, the cells are divided over p processes." << endl
+        << "or \"benchmark refresh\" to time Verlet list refreshes, \"benchmark threads\" for the" << endl
+        << "strong scaling of the force loop, \"benchmark kernel\" to compare the force kernels," << endl
+        << "\"benchmark steps\" for the steps per second of whole time steps, \"benchmark correlations\"" << endl
+        << "to compare the spatial correlations from pair sums and from FFTs, \"benchmark fluctuations\"" << endl
+        << "to compare the number fluctuations around the center of mass and on the grid." << endl
+        << "or \"sweep <file>\" to run every line of a parameter file (as written by create-arrays.sh)" << endl
+        << "in this process, --workers <n> at a time, default one per core and thread." << endl
+        << "or \"xyz <trajectory.bin> <output> [first frame [last frame]]\" to write a video in the" << endl
+        << "XYZ format for Ovito, all frames if none are given." << endl
+        << "Program exit status (1). A run stopped by SIGINT or SIGTERM exits with status " << stoppedStatus << "," << endl
+        << "after writing a checkpoint if --checkpoint is on." << endl;
         return 1;
     }
     else
@@ -920,10 +2150,9 @@ int main(int argc, char *argv[])
         l_n     = atof(argv[6]);
         rho     = atof(argv[7]);
         
-        Engine engine(dir, ID, n, steps, l_s, l_n, rho);
-        engine.start();
-        npoints = steps/engine.nSkip;
+        if(options.dim == 2) run<2>(dir, ID, n, steps, l_s, l_n, rho, options);
+        if(options.dim == 3) run<3>(dir, ID, n, steps, l_s, l_n, rho, options);
     }
 	
-    return 0;
+    return stopSignal ? stoppedStatus : 0;
 }
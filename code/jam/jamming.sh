@@ -1,5 +1,7 @@
 #!/bin/bash
-#PBS -l nodes=1:ppn=1
+#PBS -l nodes=1:ppn=32
+# The force loop runs on as many threads as ppn asks for cores (PBS_NUM_PPN), so change both
+# together by changing ppn to the cores of a node.
 
 parameters=$(sed -n -e "${PBS_ARRAYID}p" /home/dmccusker/remote/jamming-dynamics/code/jam/input.txt)
 parameterArray=($parameters)
@@ -12,5 +14,5 @@ lambda_s=${parameterArray[4]}
 lambda_n=${parameterArray[5]}
 rho=${parameterArray[6]}
 
-/home/dmccusker/remote/jamming-dynamics/code/jam/a.out $ID $currentRun $noSteps $stepsPerTime $lambda_s $lambda_n $rho
+/home/dmccusker/remote/jamming-dynamics/code/jam/a.out $ID $currentRun $noSteps $stepsPerTime $lambda_s $lambda_n $rho --threads ${PBS_NUM_PPN:-1}
 
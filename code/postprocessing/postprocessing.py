@@ -12,6 +12,7 @@ from scipy.optimize import curve_fit
 import pandas as pd
 import numpy as np
 import csv
+import json
 import os
 import math
 import sys
@@ -99,6 +100,20 @@ if fit:
 	def powerlaw(x,m,b,c):
 		return b*x**m + c
 
+### Runs made with "--series binary" have the order parameter, orientation, COM and MSD in
+### dat/series.bin instead of text files. Its columns are memory-mapped, without parsing.
+
+	def read_series(path):
+		infile = open(path, "rb")
+		meta = json.loads(infile.read(4096).split(b"\n")[1])
+		infile.close()
+		columns = {}
+		for c in meta["columns"]:
+			columns[c["name"]] = np.memmap(path, dtype=c["dtype"], mode="r", offset=c["offset"], shape=(meta["rows"],))
+		return columns
+
+	seriesColumns = [ "order", "orientation_x", "MSD", "MSD" ]
+
 ### Title, axis, I/O information for the plots. ###
 
 	titles = [ "Order parameter",
@@ -168,9 +183,27 @@ if fit:
 			plt.figure(figsize=(8,6))
 			axes = plt.gca()
 			
-			temp = pd.read_csv(readin, delimiter = "\t", usecols=[0,1], header=None)
-			x = np.array(temp[0].tolist(), dtype=float)
-			y = np.array(temp[1].tolist(), dtype=float)
+			binary = i < len(seriesColumns) and os.path.exists(directory+"/dat/series.bin")
+			
+			if binary:
+				series = read_series(directory+"/dat/series.bin")
+				written = series["t"] >= 0
+				x = np.array(series["t"][written], dtype=float)
+				y = np.array(series[seriesColumns[i]][written], dtype=float)
+			else:
+				temp = pd.read_csv(readin, delimiter = "\t", usecols=[0,1], header=None)
+				x = np.array(temp[0].tolist(), dtype=float)
+				y = np.array(temp[1].tolist(), dtype=float)
+			
+			# Runs made with "--msd-samples" have the MSD averaged over all time origins, which is
+			# fitted instead, up to half the run where there are still enough origins.
+			
+			if i==2 and os.path.exists(directory+"/dat/MSDAveraged.dat"):
+				temp = pd.read_csv(directory+"/dat/MSDAveraged.dat", delimiter = "\t", usecols=[0,1], header=None)
+				x = np.array(temp[0].tolist(), dtype=float)
+				y = np.array(temp[1].tolist(), dtype=float)
+				y = y[x <= x[-1]/2.0]
+				x = x[x <= x[-1]/2.0]
 			
 	### Order parameter ###
 			if i==0:
@@ -182,9 +215,15 @@ if fit:
 			elif i==1:
 				fig = plt.figure()
 				
+				if binary:
+					temp = pd.DataFrame({ "t": x })
+					for k in ["x", "y", "z"][0:NDIM]:
+						temp[k] = np.array(series["orientation_"+k][written])
+				
 				if NDIM==2:
 					ax = fig.add_subplot(111)
-					temp = pd.read_csv(readin, delimiter = "\t", usecols=[0,1,2], names=["t", "x", "y"], header=None)
+					if not binary:
+						temp = pd.read_csv(readin, delimiter = "\t", usecols=[0,1,2], names=["t", "x", "y"], header=None)
 					pnt = ax.scatter(temp.x,temp.y,c=temp.t)
 					cbar = plt.colorbar(pnt)
 					ax.set_xlim(-1,1)
@@ -192,7 +231,8 @@ if fit:
 				
 				if NDIM==3:
 					ax = fig.add_subplot(111, projection='3d')
-					temp = pd.read_csv(readin, delimiter = "\t", usecols=[0,1,2,3], names=["t", "x", "y", "z"], header=None)
+					if not binary:
+						temp = pd.read_csv(readin, delimiter = "\t", usecols=[0,1,2,3], names=["t", "x", "y", "z"], header=None)
 					pnt= ax.scatter(temp.x,temp.y,temp.z,marker='o',c=temp.t)
 					cbar = plt.colorbar(pnt)
 					ax.set_xlim(-1,1)